@@ -0,0 +1,866 @@
+#ifndef BTREE_HPP
+#define BTREE_HPP
+/* BTree.hpp
+ *
+ * An ordered set of unique elements stored in a B-tree: every node holds a
+ * sorted run of up to max_keys elements, and every leaf is at the same
+ * depth. A lookup touches one node per level, and with many elements per
+ * node there are far fewer levels (and cache misses) than in a binary tree.
+ *
+ * Offers the part of the BinarySearchTree interface that Map relies on, so
+ * it can be used as Map's Tree argument:
+ *   Map<std::string, int, std::less<std::string>, BTree> words;
+ *
+ * Iterators stay valid until the next insertion into or erasure from the
+ * tree, either of which may move elements between nodes.
+ */
+
+#include <cassert>    //assert
+#include <cstddef>    //size_t, ptrdiff_t
+#include <functional> //less
+#include <iterator>   //reverse_iterator, bidirectional_iterator_tag
+#include <new>        //launder
+#include <utility>    //move, pair
+
+template <typename T,
+          typename Compare=std::less<T> // default if argument isn't provided
+         >
+class BTree {
+
+  // OVERVIEW: Elements are kept in sorted order as defined by Compare, and
+  //           no two elements are equivalent.
+  //
+  // INVARIANTS: Every node other than the root holds between min_keys and
+  //             max_keys elements, and the root of a nonempty tree at least
+  //             one. An internal node with n elements has n + 1 children,
+  //             and every element of children[i] lies between elements
+  //             i - 1 and i of the node. All leaves are at the same depth.
+
+public:
+  // Elements per node: enough to fill a few cache lines, and at least 3.
+  static constexpr int max_keys =
+    256 / sizeof(T) > 3 ? static_cast<int>(256 / sizeof(T)) : 3;
+  static constexpr int min_keys = (max_keys - 1) / 2;
+
+private:
+  // A Node holds its elements in raw storage, so that T need not be
+  // default constructible and unused slots cost no construction. There is
+  // room for one element more than max_keys, so a node can take an
+  // insertion before it is split.
+  struct Node {
+    Node *parent;
+    int count;
+    bool leaf;
+    alignas(T) unsigned char storage[(max_keys + 1) * sizeof(T)];
+
+    explicit Node(bool leaf_in)
+      : parent(nullptr), count(0), leaf(leaf_in) { }
+
+    T *keys() {
+      return std::launder(reinterpret_cast<T *>(storage));
+    }
+  };
+
+  // Only internal nodes carry child pointers.
+  struct Internal : Node {
+    Node *children[max_keys + 2];
+
+    Internal() : Node(false) { }
+  };
+
+  static Internal *internal(Node *node) {
+    return static_cast<Internal *>(node);
+  }
+
+public:
+
+  // Default constructor
+  BTree() : root(nullptr), num_elements(0) { }
+
+  // Copy constructor
+  BTree(const BTree &other)
+    : root(copy_nodes_impl(other.root, nullptr)),
+      num_elements(other.num_elements) { }
+
+  // Assignment operator
+  BTree &operator=(const BTree &rhs) {
+    if (this == &rhs) {
+      return *this;
+    }
+    destroy_nodes_impl(root);
+    root = copy_nodes_impl(rhs.root, nullptr);
+    num_elements = rhs.num_elements;
+    return *this;
+  }
+
+  // Move constructor
+  // Takes other's nodes in constant time, leaving other empty.
+  BTree(BTree &&other) noexcept
+    : root(nullptr), num_elements(0) {
+    swap(other);
+  }
+
+  // Move assignment operator
+  BTree &operator=(BTree &&rhs) noexcept {
+    if (this != &rhs) {
+      clear();
+      swap(rhs);
+    }
+    return *this;
+  }
+
+  // Destructor
+  ~BTree() {
+    destroy_nodes_impl(root);
+  }
+
+  // MODIFIES: this BTree, other
+  // EFFECTS : Exchanges the contents of the two trees in constant time.
+  void swap(BTree &other) noexcept {
+    std::swap(root, other.root);
+    std::swap(num_elements, other.num_elements);
+    std::swap(less, other.less);
+  }
+
+  // MODIFIES: this BTree
+  // EFFECTS : Removes every element.
+  void clear() {
+    destroy_nodes_impl(root);
+    root = nullptr;
+    num_elements = 0;
+  }
+
+  // EFFECTS: Returns whether this BTree is empty.
+  bool empty() const {
+    return num_elements == 0;
+  }
+
+  // EFFECTS: Returns the number of elements in this BTree.
+  size_t size() const {
+    return num_elements;
+  }
+
+  // EFFECTS: Returns the number of levels of nodes in this BTree.
+  size_t height() const {
+    size_t levels = 0;
+    for (Node *node = root; node;
+         node = node->leaf ? nullptr : internal(node)->children[0]) {
+      ++levels;
+    }
+    return levels;
+  }
+
+  // EFFECTS: Returns whether the elements are in strictly increasing order.
+  bool check_sorting_invariant() const {
+    const T *prev = nullptr;
+    for (const T &elt : *this) {
+      if (prev && !less(*prev, elt)) {
+        return false;
+      }
+      prev = &elt;
+    }
+    return true;
+  }
+
+  // EFFECTS: Returns whether the node occupancy, parent links, leaf depth
+  //          and element count invariants hold.
+  bool check_balance_invariant() const {
+    int leaf_depth = -1;
+    size_t count = 0;
+    return check_nodes_impl(root, nullptr, 0, leaf_depth, count) &&
+      count == num_elements;
+  }
+
+  class Iterator {
+    // OVERVIEW: Iterator interface for BTree. Iterates over the elements in
+    //           ascending order. Iterators are bidirectional, and
+    //           decrementing an end iterator yields the last element.
+
+  public:
+    using iterator_category = std::bidirectional_iterator_tag;
+    using value_type = T;
+    using difference_type = std::ptrdiff_t;
+    using pointer = T *;
+    using reference = T &;
+
+    Iterator()
+      : tree(nullptr), node(nullptr), index(0) { }
+
+    // WARNING: As with BinarySearchTree, modifications through the
+    //          returned reference must keep the element equivalent to its
+    //          old value.
+    T &operator*() const {
+      return node->keys()[index];
+    }
+
+    T *operator->() const {
+      return &node->keys()[index];
+    }
+
+    // Prefix ++
+    Iterator &operator++() {
+      if (!node->leaf) {
+        // The next element is the first one in the subtree to its right.
+        node = leftmost(internal(node)->children[index + 1]);
+        index = 0;
+        return *this;
+      }
+      ++index;
+      // Past the end of a leaf, the next element is the one separating the
+      // closest ancestor subtree we are not the last child of.
+      while (node && index == node->count) {
+        Node *child = node;
+        node = node->parent;
+        index = node ? child_index(node, child) : 0;
+      }
+      return *this;
+    }
+
+    // Prefix --
+    // REQUIRES: this is not an iterator to the first element.
+    Iterator &operator--() {
+      if (!node) {
+        node = rightmost(tree->root);
+        index = node->count - 1;
+        return *this;
+      }
+      if (!node->leaf) {
+        node = rightmost(internal(node)->children[index]);
+        index = node->count - 1;
+        return *this;
+      }
+      while (index == 0) {
+        Node *child = node;
+        node = node->parent;
+        index = child_index(node, child);
+      }
+      --index;
+      return *this;
+    }
+
+    // Postfix ++ (implemented in terms of prefix ++)
+    Iterator operator++(int) {
+      Iterator result(*this);
+      ++(*this);
+      return result;
+    }
+
+    // Postfix -- (implemented in terms of prefix --)
+    Iterator operator--(int) {
+      Iterator result(*this);
+      --(*this);
+      return result;
+    }
+
+    bool operator==(const Iterator &rhs) const {
+      return node == rhs.node && index == rhs.index;
+    }
+
+    bool operator!=(const Iterator &rhs) const {
+      return !(*this == rhs);
+    }
+
+  private:
+    friend class BTree;
+
+    const BTree *tree;
+    Node *node;   // null for an end iterator
+    int index;
+
+    Iterator(const BTree *tree_in, Node *node_in, int index_in)
+      : tree(tree_in), node(node_in), index(index_in) { }
+  }; // BTree::Iterator
+
+  // EFFECTS: Returns an iterator to the first element in this BTree.
+  Iterator begin() const {
+    return Iterator(this, root ? leftmost(root) : nullptr, 0);
+  }
+
+  // EFFECTS: Returns an iterator to past-the-end.
+  Iterator end() const {
+    return Iterator(this, nullptr, 0);
+  }
+
+  // Type alias for iterating in descending order.
+  using Reverse_iterator = std::reverse_iterator<Iterator>;
+
+  // EFFECTS: Returns a reverse iterator to the last element in this BTree.
+  Reverse_iterator rbegin() const {
+    return Reverse_iterator(end());
+  }
+
+  // EFFECTS: Returns a reverse iterator to before-the-beginning.
+  Reverse_iterator rend() const {
+    return Reverse_iterator(begin());
+  }
+
+  // EFFECTS: Returns an Iterator to the minimum element, or an end
+  //          Iterator if the tree is empty.
+  Iterator min_element() const {
+    return begin();
+  }
+
+  // EFFECTS: Returns an Iterator to the maximum element, or an end
+  //          Iterator if the tree is empty.
+  Iterator max_element() const {
+    return root ? --end() : end();
+  }
+
+  // EFFECTS: Searches this tree for an element equivalent to query.
+  //          Returns an iterator to it if found, and an end iterator
+  //          otherwise.
+  Iterator find(const T &query) const {
+    return find<T>(query);
+  }
+
+  // EFFECTS: Same as above, for a query of any type that Compare can
+  //          compare with a T on either side.
+  template <typename Query>
+  Iterator find(const Query &query) const {
+    Node *node = root;
+    while (node) {
+      int i = lower_bound_in(node, query, less);
+      if (i < node->count && !less(query, node->keys()[i])) {
+        return Iterator(this, node, i);
+      }
+      node = node->leaf ? nullptr : internal(node)->children[i];
+    }
+    return end();
+  }
+
+  // EFFECTS: Returns an iterator to the first element that is not less
+  //          than value, or an end iterator if there is none.
+  template <typename Query>
+  Iterator lower_bound(const Query &value) const {
+    return bound([this, &value](const T &elt) { return less(elt, value); });
+  }
+
+  // EFFECTS: Returns an iterator to the first element that value is less
+  //          than, or an end iterator if there is none.
+  template <typename Query>
+  Iterator upper_bound(const Query &value) const {
+    return bound([this, &value](const T &elt) { return !less(value, elt); });
+  }
+
+  // REQUIRES: The given item is not already contained in this BTree
+  // MODIFIES: this BTree
+  // EFFECTS : Inserts item into this BTree and returns an iterator to it.
+  Iterator insert(const T &item) {
+    std::pair<Iterator, bool> result =
+      insert_unique(item, [&item]() -> const T & { return item; });
+    assert(result.second);
+    return result.first;
+  }
+
+  // REQUIRES: The given item is not already contained in this BTree
+  // MODIFIES: this BTree
+  // EFFECTS : Same as above, but moves item into the tree.
+  Iterator insert(T &&item) {
+    std::pair<Iterator, bool> result =
+      insert_unique(item, [&item]() -> T && { return std::move(item); });
+    assert(result.second);
+    return result.first;
+  }
+
+  // MODIFIES: this BTree
+  // EFFECTS : Searches for an element equivalent to query. If there is one,
+  //           returns an iterator to it and false. Otherwise inserts the
+  //           element make() returns, which must be equivalent to query,
+  //           and returns an iterator to it and true. make is called only
+  //           when inserting.
+  // NOTE    : Compare must accept a Query on either side of a T. Full nodes
+  //           on the way back up are split in two.
+  template <typename Query, typename Make>
+  std::pair<Iterator, bool> insert_unique(const Query &query, Make &&make) {
+    if (!root) {
+      root = new Node(true);
+      new (root->keys()) T(make());
+      root->count = 1;
+      ++num_elements;
+      return { Iterator(this, root, 0), true };
+    }
+
+    Node *node = root;
+    int i;
+    while (true) {
+      i = lower_bound_in(node, query, less);
+      if (i < node->count && !less(query, node->keys()[i])) {
+        return { Iterator(this, node, i), false };
+      }
+      if (node->leaf) {
+        break;
+      }
+      node = internal(node)->children[i];
+    }
+
+    insert_key(node, i, make());
+    ++num_elements;
+
+    // Split overfull nodes bottom-up, following the new element as it
+    // moves.
+    Node *where = node;
+    int where_index = i;
+    while (node->count > max_keys) {
+      int mid = node->count / 2;
+      Node *sibling = split(node, mid);
+      Node *parent = node->parent;
+      int pos;
+      if (parent) {
+        pos = child_index(parent, node);
+        insert_key(parent, pos, std::move(node->keys()[mid]));
+        insert_child(internal(parent), pos + 1, sibling);
+      }
+      else {
+        Internal *new_root = new Internal;
+        new (new_root->keys()) T(std::move(node->keys()[mid]));
+        new_root->count = 1;
+        new_root->children[0] = node;
+        new_root->children[1] = sibling;
+        node->parent = sibling->parent = new_root;
+        root = parent = new_root;
+        pos = 0;
+      }
+      node->keys()[mid].~T();
+      node->count = mid;
+
+      if (where == node) {
+        if (where_index > mid) {
+          where = sibling;
+          where_index -= mid + 1;
+        }
+        else if (where_index == mid) {
+          where = parent;
+          where_index = pos;
+        }
+      }
+      node = parent;
+    }
+    return { Iterator(this, where, where_index), true };
+  }
+
+  // REQUIRES: pos is a valid, dereferenceable iterator into this BTree
+  // MODIFIES: this BTree
+  // EFFECTS : Removes the element at pos and returns an iterator to the
+  //           element after it. Other iterators are invalidated.
+  // NOTE    : An element in an internal node is replaced by its successor,
+  //           which is always first in a leaf, so only leaves lose
+  //           elements. Nodes left with fewer than min_keys borrow from a
+  //           sibling or merge with one, on the way back up.
+  Iterator erase(Iterator pos) {
+    Iterator next = pos;
+    ++next;
+    Node *node = pos.node;
+    int i = pos.index;
+    if (!node->leaf) {
+      // next is the first element of the leftmost leaf right of pos.
+      node->keys()[i] = std::move(next.node->keys()[0]);
+      node = next.node;
+      i = 0;
+      next = pos;
+    }
+    else if (next.node == node) {
+      --next.index;
+    }
+    erase_key(node, i);
+    --num_elements;
+
+    Node *where = next.node;
+    int where_index = next.index;
+    while (node != root && node->count < min_keys) {
+      Internal *parent = internal(node->parent);
+      int k = child_index(parent, node);
+      Node *left = k > 0 ? parent->children[k - 1] : nullptr;
+      Node *right = k < parent->count ? parent->children[k + 1] : nullptr;
+      if (left && left->count > min_keys) {
+        borrow_from_left(parent, k, where, where_index);
+        break;
+      }
+      if (right && right->count > min_keys) {
+        borrow_from_right(parent, k, where, where_index);
+        break;
+      }
+      merge(parent, left ? k - 1 : k, where, where_index);
+      node = parent;
+    }
+
+    if (root->count == 0) {
+      Node *old = root;
+      if (old->leaf) {
+        root = nullptr;
+        delete old;
+      }
+      else {
+        root = internal(old)->children[0];
+        root->parent = nullptr;
+        delete internal(old);
+      }
+    }
+    return Iterator(this, where, where_index);
+  }
+
+  // MODIFIES: this BTree
+  // EFFECTS : Removes the element equivalent to value, if there is one, and
+  //           returns the number of elements removed (0 or 1).
+  template <typename Query>
+  size_t erase(const Query &value) {
+    Iterator pos = find(value);
+    if (pos == end()) {
+      return 0;
+    }
+    erase(pos);
+    return 1;
+  }
+
+  size_t erase(const T &value) {
+    return erase<T>(value);
+  }
+
+private:
+  Node *root;
+  size_t num_elements;
+
+  // An instance of the Compare type. Use this to compare elements.
+  Compare less;
+
+  // REQUIRES: before is true for a prefix of the elements in order
+  // EFFECTS : Returns an iterator to the first element for which before is
+  //           false, or an end iterator if there is none.
+  template <typename Pred>
+  Iterator bound(Pred before) const {
+    Iterator best = end();
+    Node *node = root;
+    while (node) {
+      const T *keys = node->keys();
+      int lo = 0;
+      int hi = node->count;
+      while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (before(keys[mid])) {
+          lo = mid + 1;
+        }
+        else {
+          hi = mid;
+        }
+      }
+      if (lo < node->count) {
+        best = Iterator(this, node, lo);
+      }
+      node = node->leaf ? nullptr : internal(node)->children[lo];
+    }
+    return best;
+  }
+
+  // EFFECTS: Returns the index of the first element of node that is not
+  //          less than query (node->count if there is none).
+  template <typename Query>
+  static int lower_bound_in(Node *node, const Query &query, Compare less) {
+    const T *keys = node->keys();
+    int lo = 0;
+    int hi = node->count;
+    while (lo < hi) {
+      int mid = (lo + hi) / 2;
+      if (less(keys[mid], query)) {
+        lo = mid + 1;
+      }
+      else {
+        hi = mid;
+      }
+    }
+    return lo;
+  }
+
+  // EFFECTS: Returns the position of child among parent's children.
+  static int child_index(Node *parent, Node *child) {
+    Node **children = internal(parent)->children;
+    int i = 0;
+    while (children[i] != child) {
+      ++i;
+    }
+    return i;
+  }
+
+  static Node *leftmost(Node *node) {
+    while (!node->leaf) {
+      node = internal(node)->children[0];
+    }
+    return node;
+  }
+
+  static Node *rightmost(Node *node) {
+    while (!node->leaf) {
+      node = internal(node)->children[node->count];
+    }
+    return node;
+  }
+
+  // REQUIRES: node->count <= max_keys, 0 <= i <= node->count
+  // MODIFIES: node
+  // EFFECTS : Inserts item as element i of node, shifting later elements up.
+  static void insert_key(Node *node, int i, T &&item) {
+    T *keys = node->keys();
+    int n = node->count;
+    if (i == n) {
+      new (keys + n) T(std::move(item));
+    }
+    else {
+      new (keys + n) T(std::move(keys[n - 1]));
+      for (int k = n - 1; k > i; --k) {
+        keys[k] = std::move(keys[k - 1]);
+      }
+      keys[i] = std::move(item);
+    }
+    node->count = n + 1;
+  }
+
+  static void insert_key(Node *node, int i, const T &item) {
+    insert_key(node, i, T(item));
+  }
+
+  // REQUIRES: parent has just gained element i - 1
+  // MODIFIES: parent
+  // EFFECTS : Inserts child as child i of parent, shifting later children.
+  static void insert_child(Internal *parent, int i, Node *child) {
+    for (int k = parent->count; k > i; --k) {
+      parent->children[k] = parent->children[k - 1];
+    }
+    parent->children[i] = child;
+    child->parent = parent;
+  }
+
+  // MODIFIES: node
+  // EFFECTS : Moves the elements after mid (and the children after them)
+  //           into a new sibling and returns it. Element mid is left in
+  //           place for the caller to move up.
+  static Node *split(Node *node, int mid) {
+    Node *sibling = node->leaf ? new Node(true) : new Internal;
+    T *from = node->keys();
+    T *to = sibling->keys();
+    int moved = node->count - mid - 1;
+    for (int k = 0; k < moved; ++k) {
+      new (to + k) T(std::move(from[mid + 1 + k]));
+      from[mid + 1 + k].~T();
+    }
+    sibling->count = moved;
+    if (!node->leaf) {
+      for (int k = 0; k <= moved; ++k) {
+        Node *child = internal(node)->children[mid + 1 + k];
+        internal(sibling)->children[k] = child;
+        child->parent = sibling;
+      }
+    }
+    node->count = mid + 1;
+    return sibling;
+  }
+
+  // REQUIRES: 0 <= i < node->count
+  // MODIFIES: node
+  // EFFECTS : Removes element i of node, shifting later elements down.
+  static void erase_key(Node *node, int i) {
+    T *keys = node->keys();
+    int n = node->count;
+    for (int k = i; k < n - 1; ++k) {
+      keys[k] = std::move(keys[k + 1]);
+    }
+    keys[n - 1].~T();
+    node->count = n - 1;
+  }
+
+  // REQUIRES: parent has just lost element i - 1
+  // MODIFIES: parent
+  // EFFECTS : Removes child i of parent, shifting later children down.
+  static void erase_child(Internal *parent, int i) {
+    for (int k = i; k <= parent->count; ++k) {
+      parent->children[k] = parent->children[k + 1];
+    }
+  }
+
+  // The rebalancing steps below move elements between nodes. Each keeps
+  // (where, where_index) pointing at the element it pointed at before.
+
+  // MODIFIES: parent and its children k - 1 and k
+  // EFFECTS : Moves separator k - 1 down to the front of child k and the
+  //           last element of child k - 1 up in its place.
+  static void borrow_from_left(Internal *parent, int k, Node *&where,
+                               int &where_index) {
+    Node *node = parent->children[k];
+    Node *left = parent->children[k - 1];
+    int last = left->count - 1;
+    insert_key(node, 0, std::move(parent->keys()[k - 1]));
+    parent->keys()[k - 1] = std::move(left->keys()[last]);
+    left->keys()[last].~T();
+    left->count = last;
+    if (!node->leaf) {
+      Node **children = internal(node)->children;
+      for (int c = node->count; c > 0; --c) {
+        children[c] = children[c - 1];
+      }
+      children[0] = internal(left)->children[last + 1];
+      children[0]->parent = node;
+    }
+
+    if (where == node) {
+      ++where_index;
+    }
+    else if (where == parent && where_index == k - 1) {
+      where = node;
+      where_index = 0;
+    }
+    else if (where == left && where_index == last) {
+      where = parent;
+      where_index = k - 1;
+    }
+  }
+
+  // MODIFIES: parent and its children k and k + 1
+  // EFFECTS : Moves separator k down to the end of child k and the first
+  //           element of child k + 1 up in its place.
+  static void borrow_from_right(Internal *parent, int k, Node *&where,
+                                int &where_index) {
+    Node *node = parent->children[k];
+    Node *right = parent->children[k + 1];
+    int n = node->count;
+    insert_key(node, n, std::move(parent->keys()[k]));
+    parent->keys()[k] = std::move(right->keys()[0]);
+    erase_key(right, 0);
+    if (!node->leaf) {
+      Node **children = internal(right)->children;
+      internal(node)->children[n + 1] = children[0];
+      children[0]->parent = node;
+      for (int c = 0; c <= right->count; ++c) {
+        children[c] = children[c + 1];
+      }
+    }
+
+    if (where == parent && where_index == k) {
+      where = node;
+      where_index = n;
+    }
+    else if (where == right) {
+      if (where_index == 0) {
+        where = parent;
+        where_index = k;
+      }
+      else {
+        --where_index;
+      }
+    }
+  }
+
+  // MODIFIES: parent and its children k and k + 1
+  // EFFECTS : Appends separator k and every element and child of child
+  //           k + 1 to child k, and removes both from parent.
+  static void merge(Internal *parent, int k, Node *&where,
+                    int &where_index) {
+    Node *left = parent->children[k];
+    Node *right = parent->children[k + 1];
+    int offset = left->count;
+    T *keys = left->keys();
+    new (keys + offset) T(std::move(parent->keys()[k]));
+    for (int c = 0; c < right->count; ++c) {
+      new (keys + offset + 1 + c) T(std::move(right->keys()[c]));
+      right->keys()[c].~T();
+    }
+    left->count = offset + 1 + right->count;
+    erase_key(parent, k);
+    erase_child(parent, k + 1);
+    if (left->leaf) {
+      delete right;
+    }
+    else {
+      for (int c = 0; c <= right->count; ++c) {
+        Node *child = internal(right)->children[c];
+        internal(left)->children[offset + 1 + c] = child;
+        child->parent = left;
+      }
+      delete internal(right);
+    }
+
+    if (where == parent) {
+      if (where_index == k) {
+        where = left;
+        where_index = offset;
+      }
+      else if (where_index > k) {
+        --where_index;
+      }
+    }
+    else if (where == right) {
+      where = left;
+      where_index += offset + 1;
+    }
+  }
+
+  // EFFECTS: Returns a deep copy of the subtree rooted at node, whose root
+  //          has the given parent.
+  // NOTE:    This function is tree recursive.
+  static Node *copy_nodes_impl(Node *node, Node *parent) {
+    if (!node) {
+      return nullptr;
+    }
+    Node *copy = node->leaf ? new Node(true) : new Internal;
+    copy->parent = parent;
+    for (int k = 0; k < node->count; ++k) {
+      new (copy->keys() + k) T(node->keys()[k]);
+      copy->count = k + 1;
+    }
+    if (!node->leaf) {
+      for (int k = 0; k <= node->count; ++k) {
+        internal(copy)->children[k] =
+          copy_nodes_impl(internal(node)->children[k], copy);
+      }
+    }
+    return copy;
+  }
+
+  // EFFECTS: Frees every node in the subtree rooted at node.
+  // NOTE:    This function is tree recursive.
+  static void destroy_nodes_impl(Node *node) {
+    if (!node) {
+      return;
+    }
+    for (int k = 0; k < node->count; ++k) {
+      node->keys()[k].~T();
+    }
+    if (node->leaf) {
+      delete node;
+      return;
+    }
+    for (int k = 0; k <= node->count; ++k) {
+      destroy_nodes_impl(internal(node)->children[k]);
+    }
+    delete internal(node);
+  }
+
+  // EFFECTS: Returns whether the subtree rooted at node, at the given
+  //          depth, has the given parent and legal node occupancy, with
+  //          all leaves at depth leaf_depth (set by the first leaf found if
+  //          negative). Adds the number of elements to count.
+  // NOTE:    This function is tree recursive.
+  static bool check_nodes_impl(Node *node, Node *parent, int depth,
+                               int &leaf_depth, size_t &count) {
+    if (!node) {
+      return parent == nullptr;
+    }
+    int low = parent ? min_keys : 1;
+    if (node->parent != parent || node->count < low ||
+        node->count > max_keys) {
+      return false;
+    }
+    count += node->count;
+    if (node->leaf) {
+      if (leaf_depth < 0) {
+        leaf_depth = depth;
+      }
+      return leaf_depth == depth;
+    }
+    for (int k = 0; k <= node->count; ++k) {
+      if (!check_nodes_impl(internal(node)->children[k], node, depth + 1,
+                            leaf_depth, count)) {
+        return false;
+      }
+    }
+    return true;
+  }
+};
+
+#endif
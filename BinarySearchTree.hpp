@@ -18,13 +18,323 @@
 
 #include <cassert>  //assert
 #include <iostream> //ostream
+#include <limits> //numeric_limits
 #include <functional> //less
+#include <iterator> //reverse_iterator, bidirectional_iterator_tag, distance
+#include <cstddef> //ptrdiff_t
+#include <utility> //move, pair, forward
+#include <new> //operator new, align_val_t
+#include <type_traits> //is_trivially_destructible
 
 // You may add aditional libraries here if needed. You may use any
 // part of the STL except for containers.
 
+// BALANCING POLICIES
+// The Balance parameter of BinarySearchTree decides whether and how the
+// tree restructures itself as elements are inserted. A policy provides:
+//   node_data       - extra per-node state, inherited by every Node
+//   update(node)    - recomputes node_data for node from its children
+//   rebalance<Rotations>(node)
+//                   - restores the policy's invariant at node, given that
+//                     it holds in both subtrees, using Rotations::rotate_left
+//                     and Rotations::rotate_right; returns the subtree root
+//   check(node, h)  - returns whether the invariant holds on the subtree
+//                     rooted at node, setting h to its height
+
+// A plain binary search tree: no restructuring, so the shape depends on the
+// insertion order and sorted input degenerates into a list.
+struct bst_unbalanced {
+  struct node_data { };
+
+  template <typename Node>
+  static void update(Node *) { }
+
+  template <typename Rotations, typename Node>
+  static Node * rebalance(Node *node) {
+    return node;
+  }
+
+  template <typename Node>
+  static bool check(const Node *, int &) {
+    return true;
+  }
+};
+
+// An AVL tree: the heights of the two subtrees of every node differ by at
+// most one, which bounds the height at about 1.44 log2(n).
+struct bst_avl {
+  struct node_data {
+    int height = 1;
+  };
+
+  template <typename Node>
+  static int height(const Node *node) {
+    return node ? node->height : 0;
+  }
+
+  template <typename Node>
+  static void update(Node *node) {
+    int left = height(node->left);
+    int right = height(node->right);
+    node->height = 1 + (left > right ? left : right);
+  }
+
+  template <typename Rotations, typename Node>
+  static Node * rebalance(Node *node) {
+    update(node);
+    int balance = height(node->left) - height(node->right);
+    if (balance > 1) {
+      if (height(node->left->left) < height(node->left->right)) {
+        node->left = Rotations::rotate_left(node->left);
+      }
+      return Rotations::rotate_right(node);
+    }
+    if (balance < -1) {
+      if (height(node->right->right) < height(node->right->left)) {
+        node->right = Rotations::rotate_right(node->right);
+      }
+      return Rotations::rotate_left(node);
+    }
+    return node;
+  }
+
+  template <typename Node>
+  static bool check(const Node *node, int &h) {
+    if (!node) {
+      h = 0;
+      return true;
+    }
+    int left, right;
+    if (!check(node->left, left) || !check(node->right, right)) {
+      return false;
+    }
+    h = 1 + (left > right ? left : right);
+    return node->height == h && left - right <= 1 && right - left <= 1;
+  }
+};
+
+// NODE ALLOCATION POLICIES
+// The Alloc parameter of BinarySearchTree decides where nodes live. A policy
+// provides a class template pool<Node>, one instance of which each tree
+// owns, with:
+//   create(args...)  - returns a new Node constructed from args
+//   destroy(node)    - destroys and frees a node returned by create
+//   frees_in_bulk    - whether the pool's destructor and clear() free every
+//                      node it handed out, so a tree of trivially
+//                      destructible nodes need not visit them one by one
+//   clear()          - frees every node at once, if frees_in_bulk
+//   swap(other)      - exchanges the nodes of two pools in constant time
+
+// Every node is its own new/delete.
+struct bst_new_delete {
+  template <typename Node>
+  class pool {
+  public:
+    static constexpr bool frees_in_bulk = false;
+
+    template <typename... Args>
+    Node * create(Args &&... args) {
+      return new Node(std::forward<Args>(args)...);
+    }
+
+    void destroy(Node *node) {
+      delete node;
+    }
+
+    void clear() { }
+
+    void swap(pool &) { }
+  };
+};
+
+// Nodes are carved out of blocks that double in size, up to a cap, as the
+// tree grows; destroyed nodes go on a free list for the next create. The
+// blocks are only returned when the pool is cleared or destroyed, which
+// takes one delete per block. A pool is not shared between trees, so a
+// copy of a tree gets its own.
+struct bst_node_pool {
+  template <typename Node>
+  class pool {
+  public:
+    static constexpr bool frees_in_bulk = true;
+
+    pool()
+      : blocks(nullptr), free_list(nullptr), next(nullptr), end(nullptr),
+        block_slots(0) { }
+
+    pool(const pool &) = delete;
+    pool &operator=(const pool &) = delete;
+
+    ~pool() {
+      clear();
+    }
+
+    template <typename... Args>
+    Node * create(Args &&... args) {
+      Slot *slot = take();
+      try {
+        return new (slot->storage) Node(std::forward<Args>(args)...);
+      }
+      catch (...) {
+        give_back(slot);
+        throw;
+      }
+    }
+
+    void destroy(Node *node) {
+      node->~Node();
+      give_back(reinterpret_cast<Slot *>(node));
+    }
+
+    void swap(pool &other) {
+      std::swap(blocks, other.blocks);
+      std::swap(free_list, other.free_list);
+      std::swap(next, other.next);
+      std::swap(end, other.end);
+      std::swap(block_slots, other.block_slots);
+    }
+
+    // REQUIRES: the nodes still allocated are trivially destructible, or
+    //           have already been destroyed
+    void clear() {
+      while (blocks) {
+        Block *prev = blocks->prev;
+        ::operator delete(blocks, std::align_val_t(block_align));
+        blocks = prev;
+      }
+      free_list = next = end = nullptr;
+      block_slots = 0;
+    }
+
+  private:
+    union Slot {
+      Slot *next_free;
+      alignas(Node) unsigned char storage[sizeof(Node)];
+    };
+
+    // Each block starts with a link to the previously allocated block,
+    // followed by its slots.
+    struct Block {
+      Block *prev;
+    };
+
+    static constexpr size_t block_align =
+      alignof(Slot) > alignof(Block) ? alignof(Slot) : alignof(Block);
+    static constexpr size_t header_size =
+      (sizeof(Block) + block_align - 1) / block_align * block_align;
+    static constexpr size_t first_block_slots = 32;
+    static constexpr size_t max_block_slots = 8192;
+
+    Block *blocks;     // most recently allocated block
+    Slot *free_list;   // slots of destroyed nodes
+    Slot *next;        // first never-used slot in the newest block
+    Slot *end;         // one past the last slot in the newest block
+    size_t block_slots;
+
+    Slot * take() {
+      if (free_list) {
+        Slot *slot = free_list;
+        free_list = slot->next_free;
+        return slot;
+      }
+      if (next == end) {
+        block_slots = block_slots ? block_slots * 2 : first_block_slots;
+        if (block_slots > max_block_slots) {
+          block_slots = max_block_slots;
+        }
+        void *raw = ::operator new(header_size + block_slots * sizeof(Slot),
+                                   std::align_val_t(block_align));
+        Block *block = static_cast<Block *>(raw);
+        block->prev = blocks;
+        blocks = block;
+        next = reinterpret_cast<Slot *>(static_cast<unsigned char *>(raw) +
+                                        header_size);
+        end = next + block_slots;
+      }
+      return next++;
+    }
+
+    void give_back(Slot *slot) {
+      slot->next_free = free_list;
+      free_list = slot;
+    }
+  };
+};
+
+// KERNEL POLICIES
+// The Kernels parameter of BinarySearchTree decides how find, insert, copy,
+// destroy, height and the min/max searches walk the tree. The recursive
+// kernels use one stack frame per level, so a degenerate tree (e.g. an
+// unbalanced tree built from sorted input) tens of thousands of levels
+// deep overflows the stack. The iterative kernels use loops and the parent
+// links instead and run in constant stack space at any depth. The
+// diagnostic walks (the invariant checks, traversals and to_string) are
+// recursive under either policy.
+struct bst_recursive {
+  static constexpr bool iterative = false;
+};
+
+struct bst_iterative {
+  static constexpr bool iterative = true;
+};
+
+// TREE STATISTICS
+// The shape of a tree, as returned by BinarySearchTree::stats(). Depths
+// count edges from the root, so the root is at depth 0 and the height of a
+// non-empty tree is max_depth + 1.
+struct bst_stats {
+  // Nodes at depth histogram_buckets - 1 or deeper share the last bucket.
+  static constexpr size_t histogram_buckets = 64;
+
+  size_t nodes = 0;
+  size_t height = 0;
+  size_t max_depth = 0;
+  double average_depth = 0;
+  size_t optimal_height = 0;  // smallest height that can hold nodes
+  double height_ratio = 1;    // height / optimal_height, 1 when empty
+  size_t node_bytes = 0;      // size of one node
+  size_t memory_bytes = 0;    // the tree object plus nodes * node_bytes,
+                              // not counting allocator overhead
+  size_t depth_histogram[histogram_buckets] = {};  // nodes at each depth
+
+  // MODIFIES: os
+  // EFFECTS : Writes these statistics to os as a single-line JSON object.
+  //           The histogram is written up to the deepest bucket in use.
+  //           Doubles are written with enough digits to read back
+  //           exactly, whatever the formatting state of os, which is left
+  //           as it was. Returns os.
+  std::ostream &to_json(std::ostream &os) const {
+    std::ios_base::fmtflags flags = os.flags();
+    std::streamsize precision = os.precision();
+    os.flags(std::ios_base::dec);
+    os.precision(std::numeric_limits<double>::max_digits10);
+    os.width(0);
+    os << "{\"nodes\":" << nodes
+       << ",\"height\":" << height
+       << ",\"max_depth\":" << max_depth
+       << ",\"average_depth\":" << average_depth
+       << ",\"optimal_height\":" << optimal_height
+       << ",\"height_ratio\":" << height_ratio
+       << ",\"node_bytes\":" << node_bytes
+       << ",\"memory_bytes\":" << memory_bytes
+       << ",\"depth_histogram\":[";
+    size_t used = nodes == 0 ? 0
+      : (max_depth < histogram_buckets ? max_depth + 1 : histogram_buckets);
+    for (size_t d = 0; d < used; ++d) {
+      os << (d ? "," : "") << depth_histogram[d];
+    }
+    os << "]}";
+    os.flags(flags);
+    os.precision(precision);
+    return os;
+  }
+};
+
 template <typename T,
-          typename Compare=std::less<T> // default if argument isn't provided
+          typename Compare=std::less<T>, // default if argument isn't provided
+          typename Balance=bst_unbalanced,
+          typename Alloc=bst_new_delete,
+          typename Kernels=bst_iterative
          >
 class BinarySearchTree {
 
@@ -64,25 +374,39 @@ class BinarySearchTree {
   // "greater than" end up meaning the same thing when duplicates are
   // not allowed.
 
-  // NOTE: Any operation you define must use RECURSION rather than iteration.
-  //       You may NOT use any looping constructs.
+  // NOTE: Operations that walk the tree go through the Kernels policy. The
+  //       default, bst_iterative, uses loops and parent links and needs
+  //       constant stack space at any depth; bst_recursive keeps the
+  //       original one-frame-per-level recursion. Diagnostic walks remain
+  //       recursive under either policy (see KERNEL POLICIES above).
 
 private:
 
-  // A Node stores an element and pointers to its left and right children
-  // DO NOT change this struct definition.
-  struct Node {
+  // A Node stores an element, pointers to its left and right children and
+  // its parent (null for the root), and the number of nodes in the subtree
+  // it roots, plus whatever bookkeeping the balancing policy needs.
+  struct Node : Balance::node_data {
 
     // Default constructor - does nothing
     Node() {}
 
     // Custom constructor provided for convenience
     Node(const T &datum_in, Node *left_in, Node *right_in)
-            : datum(datum_in), left(left_in), right(right_in) { }
+            : datum(datum_in), left(left_in), right(right_in),
+              parent(nullptr),
+              subtree_size(1 + size_impl(left_in) + size_impl(right_in)) { }
+
+    // Same, but moves the element into the node.
+    Node(T &&datum_in, Node *left_in, Node *right_in)
+            : datum(std::move(datum_in)), left(left_in), right(right_in),
+              parent(nullptr),
+              subtree_size(1 + size_impl(left_in) + size_impl(right_in)) { }
 
     T datum;
     Node *left;
     Node *right;
+    Node *parent;
+    size_t subtree_size;
   };
 
 public:
@@ -90,25 +414,65 @@ public:
   // Default constructor
   // (Note this will default construct the less comparator)
   BinarySearchTree()
-    : root(nullptr) { }
+    : root(nullptr), min_node(nullptr), max_node(nullptr) { }
 
   // Copy constructor
   BinarySearchTree(const BinarySearchTree &other)
-    : root(copy_nodes_impl(other.root)) { }
+    : root(copy_nodes_impl(other.root, nodes)),
+      min_node(min_element_impl(root)), max_node(max_element_impl(root)) { }
 
   // Assignment operator
   BinarySearchTree &operator=(const BinarySearchTree &rhs) {
     if (this == &rhs) {
       return *this;
     }
-    destroy_nodes_impl(root);
-    root = copy_nodes_impl(rhs.root);
+    destroy_all_nodes();
+    root = copy_nodes_impl(rhs.root, nodes);
+    min_node = min_element_impl(root);
+    max_node = max_element_impl(root);
+    return *this;
+  }
+
+  // Move constructor
+  // Takes other's nodes in constant time, leaving other empty.
+  BinarySearchTree(BinarySearchTree &&other) noexcept
+    : root(nullptr), min_node(nullptr), max_node(nullptr) {
+    swap(other);
+  }
+
+  // Move assignment operator
+  // Frees this tree's nodes and takes rhs's, leaving rhs empty.
+  BinarySearchTree &operator=(BinarySearchTree &&rhs) noexcept {
+    if (this != &rhs) {
+      clear();
+      swap(rhs);
+    }
     return *this;
   }
 
   // Destructor
   ~BinarySearchTree() {
-    destroy_nodes_impl(root);
+    destroy_all_nodes();
+  }
+
+  // MODIFIES: this BinarySearchTree, other
+  // EFFECTS : Exchanges the contents of the two trees in constant time.
+  //           Iterators keep pointing to the same elements, now in the
+  //           other tree, except that decrementing an end iterator
+  //           yields the last element of the tree it was taken from.
+  void swap(BinarySearchTree &other) noexcept {
+    nodes.swap(other.nodes);
+    std::swap(root, other.root);
+    std::swap(min_node, other.min_node);
+    std::swap(max_node, other.max_node);
+    std::swap(less, other.less);
+  }
+
+  // MODIFIES: this BinarySearchTree
+  // EFFECTS : Removes and frees every element.
+  void clear() {
+    destroy_all_nodes();
+    root = min_node = max_node = nullptr;
   }
   // why is this destructor causing a segefault?
   // a: because the destructor is called on a temporary object
@@ -127,9 +491,34 @@ public:
     return static_cast<size_t>(height_impl(root));
   }
 
+  // EFFECTS: Returns the shape of the tree: node count, height, average
+  //          and maximum depth, depth histogram, ratio of the height to the
+  //          optimal height, and approximate memory footprint.
+  // NOTE:    Makes a single walk through the parent links in constant
+  //          stack space, under either Kernels policy, so it is safe to
+  //          call on the degenerate trees it is meant to diagnose.
+  bst_stats stats() const {
+    bst_stats result;
+    size_t depth_sum = stats_impl(root, result);
+    result.height = result.nodes ? result.max_depth + 1 : 0;
+    for (size_t n = result.nodes; n; n >>= 1) {
+      ++result.optimal_height;
+    }
+    if (result.nodes) {
+      result.average_depth =
+        static_cast<double>(depth_sum) / static_cast<double>(result.nodes);
+      result.height_ratio = static_cast<double>(result.height) /
+        static_cast<double>(result.optimal_height);
+    }
+    result.node_bytes = sizeof(Node);
+    result.memory_bytes = sizeof(*this) + result.nodes * sizeof(Node);
+    return result;
+  }
+
   // EFFECTS: Returns the number of elements in this BinarySearchTree.
+  // NOTE:    Runs in constant time; every node keeps its subtree size.
   size_t size() const {
-    return static_cast<size_t>(size_impl(root));
+    return size_impl(root);
   }
 
   // EFFECTS: Traverses the tree using an in-order traversal,
@@ -156,16 +545,37 @@ public:
     return check_sorting_invariant_impl(root, less);
   }
 
+  // EFFECTS: Returns whether the balancing policy's invariant (and any
+  //          per-node bookkeeping it keeps) holds on this BinarySearchTree.
+  //          Always true for bst_unbalanced.
+  //          Also checks the parent links and subtree sizes every tree
+  //          keeps, and the cached minimum and maximum.
+  bool check_balance_invariant() const {
+    int h;
+    return Balance::check(root, h) && check_links_impl(root, nullptr) &&
+      min_node == min_element_impl(root) && max_node == max_element_impl(root);
+  }
+
   class Iterator {
     // OVERVIEW: Iterator interface for BinarySearchTree.
     //           Iterates over the elements in ascending order as defined
     //           by the sorted ordering of the BinarySearchTree.
 
+    //           Iterators are bidirectional: each step follows child and
+    //           parent links, so a full traversal in either direction
+    //           touches every edge twice and one step is amortized O(1).
+
     // Big Three for Iterator not needed
 
   public:
+    using iterator_category = std::bidirectional_iterator_tag;
+    using value_type = T;
+    using difference_type = std::ptrdiff_t;
+    using pointer = T *;
+    using reference = T &;
+
     Iterator()
-      : root(nullptr), current_node(nullptr) {}
+      : tree(nullptr), current_node(nullptr) {}
 
     // EFFECTS:  Returns the current element by reference.
     // WARNING:  Dereferencing an iterator returns an element from the tree
@@ -202,12 +612,46 @@ public:
         current_node = min_element_impl(current_node->right);
       }
       else {
-        // Otherwise, look in the whole tree for the next biggest element
-        current_node = min_greater_than_impl(root, current_node->datum, less);
+        // Otherwise, the next element is the closest ancestor whose left
+        // subtree we are in
+        Node *child = current_node;
+        current_node = current_node->parent;
+        while (current_node && child == current_node->right) {
+          child = current_node;
+          current_node = current_node->parent;
+        }
       }
       return *this;
     }
 
+    // Prefix --
+    // REQUIRES: this is not an iterator to the first element.
+    //           Decrementing an end iterator yields the last element.
+    Iterator &operator--() {
+      if (!current_node) {
+        current_node = tree->max_node;
+      }
+      else if (current_node->left) {
+        current_node = max_element_impl(current_node->left);
+      }
+      else {
+        Node *child = current_node;
+        current_node = current_node->parent;
+        while (current_node && child == current_node->left) {
+          child = current_node;
+          current_node = current_node->parent;
+        }
+      }
+      return *this;
+    }
+
+    // Postfix -- (implemented in terms of prefix --)
+    Iterator operator--(int) {
+      Iterator result(*this);
+      --(*this);
+      return result;
+    }
+
     // Postfix ++ (implemented in terms of prefix ++)
     Iterator operator++(int) {
       Iterator result(*this);
@@ -226,12 +670,13 @@ public:
   private:
     friend class BinarySearchTree;
 
-    Node *root;
+    // The tree is only consulted to decrement an end iterator, which
+    // yields its cached maximum.
+    const BinarySearchTree *tree;
     Node *current_node;
-    Compare less;
 
-    Iterator(Node *root_in, Node* current_node_in, Compare less_in)
-      : root(root_in), current_node(current_node_in), less(less_in) { }
+    Iterator(const BinarySearchTree *tree_in, Node* current_node_in)
+      : tree(tree_in), current_node(current_node_in) { }
 
   }; // BinarySearchTree::Iterator
   ////////////////////////////////////////
@@ -239,36 +684,84 @@ public:
 
   // EFFECTS : Returns an iterator to the first element
   //           in this BinarySearchTree.
+  // NOTE    : Runs in constant time; the minimum is cached.
   Iterator begin() const {
-    if (root == nullptr) {
-      return Iterator();
-    }
-    return Iterator(root, min_element_impl(root), less);
+    return Iterator(this, min_node);
   }
 
   // EFFECTS: Returns an iterator to past-the-end.
   Iterator end() const {
-    return Iterator();
+    return Iterator(this, nullptr);
+  }
+
+  // Type alias for iterating in descending order.
+  using Reverse_iterator = std::reverse_iterator<Iterator>;
+
+  // EFFECTS : Returns a reverse iterator to the last element
+  //           in this BinarySearchTree.
+  Reverse_iterator rbegin() const {
+    return Reverse_iterator(end());
+  }
+
+  // EFFECTS: Returns a reverse iterator to before-the-beginning.
+  Reverse_iterator rend() const {
+    return Reverse_iterator(begin());
   }
 
 
   // EFFECTS: Returns an Iterator to the minimum element in this
   //          BinarySearchTree or an end Iterator if the tree is empty.
   Iterator min_element() const {
-    return Iterator(root, min_element_impl(root), less);
+    return Iterator(this, min_node);
   }
 
   // EFFECTS: Returns an Iterator to the maximum element in this
   //          BinarySearchTree or an end Iterator if the tree is empty.
   Iterator max_element() const {
-    return Iterator(root, max_element_impl(root), less);
+    return Iterator(this, max_node);
   }
 
   // EFFECTS: Returns an Iterator to the minimum element in this
   //          BinarySearchTree greater than the given value.
   //          If the tree is empty, returns an end Iterator.
   Iterator min_greater_than(const T &value) const {
-    return Iterator(root, min_greater_than_impl(root, value, less), less);
+    return Iterator(this, min_greater_than_impl(root, value, less));
+  }
+
+  // EFFECTS: Returns an Iterator to the first element that is not less
+  //          than value, or an end Iterator if there is none.
+  // NOTE:    value may be of any type Compare accepts on either side of
+  //          a T; see find.
+  template <typename Query>
+  Iterator lower_bound(const Query &value) const {
+    return Iterator(this, lower_bound_impl(root, value, less));
+  }
+
+  // EFFECTS: Returns an Iterator to the first element that value is less
+  //          than, or an end Iterator if there is none.
+  template <typename Query>
+  Iterator upper_bound(const Query &value) const {
+    return Iterator(this, upper_bound_impl(root, value, less));
+  }
+
+  // EFFECTS: Returns an Iterator to the element with exactly k smaller
+  //          elements in this BinarySearchTree (so nth(0) is the minimum),
+  //          or an end Iterator if k >= size(). Runs in O(height).
+  Iterator nth(size_t k) const {
+    return Iterator(this, nth_impl(root, k));
+  }
+
+  // EFFECTS: Returns the number of elements in this BinarySearchTree that
+  //          are less than value. Runs in O(height).
+  // NOTE:    value may be of any type Compare accepts on either side of
+  //          a T; see find.
+  template <typename Query>
+  size_t rank(const Query &value) const {
+    return rank_impl(root, value, less, 0);
+  }
+
+  size_t rank(const T &value) const {
+    return rank_impl(root, value, less, 0);
   }
 
 
@@ -282,7 +775,16 @@ public:
   //          to the existing value. Otherwise, the sorting invariant
   //          will no longer hold.
   Iterator find(const T &query) const {
-    return Iterator(root, find_impl(root, query, less), less);
+    return Iterator(this, find_impl(root, query, less));
+  }
+
+  // EFFECTS: Same as above, for a query of any type that Compare can
+  //          compare with a T on either side. Lets a tree of pairs be
+  //          searched by key, or a tree of strings by a string_view with a
+  //          transparent comparator, without building a T.
+  template <typename Query>
+  Iterator find(const Query &query) const {
+    return Iterator(this, find_impl(root, query, less));
   }
 
   // REQUIRES: The given item is not already contained in this 
@@ -291,9 +793,107 @@ public:
   // EFFECTS : Inserts the element k into this BinarySearchTree, maintaining
   //           the sorting invariant.
   Iterator insert(const T &item) {
-    assert(find(item) == end());
-    root = insert_impl(root, item, less);
-    return find(item);
+    std::pair<Iterator, bool> result =
+      insert_unique(item, [&item]() -> const T & { return item; });
+    assert(result.second);
+    return result.first;
+  }
+
+  // REQUIRES: The given item is not already contained in this
+  //           BinarySearchTree
+  // MODIFIES: this BinarySearchTree
+  // EFFECTS : Same as above, but moves item into the tree.
+  Iterator insert(T &&item) {
+    std::pair<Iterator, bool> result =
+      insert_unique(item, [&item]() -> T && { return std::move(item); });
+    assert(result.second);
+    return result.first;
+  }
+
+  // MODIFIES: this BinarySearchTree
+  // EFFECTS : Searches for an element equivalent to query. If there is one,
+  //           returns an iterator to it and false. Otherwise inserts the
+  //           element make() returns, which must be equivalent to query,
+  //           and returns an iterator to it and true. make is called only
+  //           when inserting, so its arguments are left untouched otherwise.
+  // NOTE    : Compare must accept a Query on either side of a T. Takes one
+  //           descent of the tree, however the element is built.
+  template <typename Query, typename Make>
+  std::pair<Iterator, bool> insert_unique(const Query &query, Make &&make) {
+    Node *node = nullptr;
+    bool inserted = false;
+    root = insert_impl(root, query, make, less, nodes, node, inserted);
+    root->parent = nullptr;
+    if (!inserted) {
+      return { Iterator(this, node), false };
+    }
+    if (!min_node || less(node->datum, min_node->datum)) {
+      min_node = node;
+    }
+    if (!max_node || less(max_node->datum, node->datum)) {
+      max_node = node;
+    }
+    return { Iterator(this, node), true };
+  }
+
+  // REQUIRES: [first, last) is a forward range whose elements are in
+  //           strictly increasing order, as defined by Compare
+  // MODIFIES: this BinarySearchTree
+  // EFFECTS : Replaces the contents of this BinarySearchTree with the
+  //           elements of [first, last), arranged as a tree of minimal
+  //           height. Runs in linear time. Debug builds assert that the
+  //           input is sorted.
+  // NOTE    : Pass move iterators to move the elements in.
+  template <typename Iter>
+  void assign_sorted(Iter first, Iter last) {
+    size_t n = static_cast<size_t>(std::distance(first, last));
+    destroy_all_nodes();
+    root = nullptr;
+    const T *prev = nullptr;
+    root = build_sorted_impl(first, n, nodes, less, prev);
+    min_node = min_element_impl(root);
+    max_node = max_element_impl(root);
+  }
+
+  // REQUIRES: pos is a valid, dereferenceable iterator into this tree
+  // MODIFIES: this BinarySearchTree
+  // EFFECTS : Removes and frees the element at pos and returns an iterator
+  //           to the element after it. Other iterators stay valid: nodes
+  //           are relinked, never copied. Takes time proportional to the
+  //           height of the tree.
+  Iterator erase(Iterator pos) {
+    Node *node = pos.current_node;
+    Iterator next = pos;
+    ++next;
+    if (node == max_node) {
+      Iterator prev = pos;
+      max_node = node == min_node ? nullptr : (--prev).current_node;
+    }
+    if (node == min_node) {
+      min_node = next.current_node;
+    }
+    root = erase_impl(root, node);
+    nodes.destroy(node);
+    return next;
+  }
+
+  // MODIFIES: this BinarySearchTree
+  // EFFECTS : Removes the element equivalent to value, if there is one,
+  //           and returns the number of elements removed (0 or 1).
+  // NOTE    : value may be of any type Compare accepts on either side of
+  //           a T; see find.
+  template <typename Query>
+  size_t erase(const Query &value) {
+    Iterator pos = find(value);
+    if (pos == end()) {
+      return 0;
+    }
+    erase(pos);
+    return 1;
+  }
+
+  size_t erase(const T &value) {
+    return erase<T>(value);
   }
 
   // EFFECTS: Returns a human-readable string representation of this
@@ -307,9 +907,17 @@ public:
 private:
 
   // DATA REPRESENTATION
+  // Where the nodes are allocated. Declared first so that it outlives them.
+  using Node_pool = typename Alloc::template pool<Node>;
+  Node_pool nodes;
+
   // The root node of this BinarySearchTree.
   Node *root;
 
+  // The nodes holding the minimum and maximum elements, or null if empty.
+  Node *min_node;
+  Node *max_node;
+
   // An instance of the Compare type. Use this to compare elements.
   Compare less;
 
@@ -325,6 +933,19 @@ private:
   //       anything with it. DO NOT CHANGE.
   int get_max_elt_width() const;
 
+  // MODIFIES: this BinarySearchTree
+  // EFFECTS : Frees every node, leaving root dangling. Pools that free in
+  //           bulk release their blocks without visiting the nodes when
+  //           there are no destructors to run.
+  void destroy_all_nodes() {
+    if (Node_pool::frees_in_bulk && std::is_trivially_destructible<Node>::value) {
+      nodes.clear();
+    }
+    else {
+      destroy_nodes_impl(root, nodes);
+    }
+  }
+
 
 
 // ---------- DO NOT CHANGE ANYTHING IN THIS FILE ABOVE THIS LINE ----------
@@ -345,13 +966,69 @@ private:
   // EFFECTS: Returns the size of the tree rooted at 'node', which is the
   //          total number of nodes in that tree. The size of an empty
   //          tree is 0.
+  // NOTE:    This function runs in constant time: each node stores the
+  //          size of its subtree.
+  static size_t size_impl(const Node *node) {
+    return node ? node->subtree_size : 0;
+  }
+
+  // MODIFIES: node
+  // EFFECTS : Recomputes the subtree size stored in 'node' from its
+  //           children.
+  static void update_size_impl(Node *node) {
+    node->subtree_size = 1 + size_impl(node->left) + size_impl(node->right);
+  }
+
+  // EFFECTS: Returns whether every node in the tree rooted at 'node' has the
+  //          given parent link (children: the node itself) and a correct
+  //          subtree size.
   // NOTE:    This function must be tree recursive.
-  static int size_impl(const Node *node) {
-    if (!node) { // BASE CASE
-      return 0;
+  static bool check_links_impl(const Node *node, const Node *parent) {
+    if (!node) {
+      return true;
+    }
+    return node->parent == parent &&
+      node->subtree_size ==
+        1 + size_impl(node->left) + size_impl(node->right) &&
+      check_links_impl(node->left, node) &&
+      check_links_impl(node->right, node);
+  }
+
+  // EFFECTS: Returns a pointer to the node with exactly k smaller elements
+  //          in the tree rooted at 'node', or a null pointer if there is
+  //          none.
+  static Node * nth_impl(Node *node, size_t k) {
+    while (node) {
+      size_t left = size_impl(node->left);
+      if (k < left) {
+        node = node->left;
+      }
+      else if (k == left) {
+        return node;
+      }
+      else {
+        k -= left + 1;
+        node = node->right;
+      }
+    }
+    return nullptr;
+  }
+
+  // EFFECTS: Returns 'smaller' plus the number of elements in the tree
+  //          rooted at 'node' that are less than 'value'.
+  template <typename Query>
+  static size_t rank_impl(const Node *node, const Query &value, Compare less,
+                          size_t smaller) {
+    while (node) {
+      if (less(node->datum, value)) {
+        smaller += size_impl(node->left) + 1;
+        node = node->right;
+      }
+      else {
+        node = node->left;
+      }
     }
-    // RECURSIVE CASE
-    return 1 + size_impl(node->left) + size_impl(node->right);
+    return smaller;
   }
 
   // EFFECTS: Returns the height of the tree rooted at 'node', which is the
@@ -359,6 +1036,9 @@ private:
   //          The height of an empty tree is 0.
   // NOTE:    This function must be tree recursive.
   static int height_impl(const Node *node) {
+    if constexpr (Kernels::iterative) {
+      return height_loop_impl(node);
+    }
     if (!node) {
       return 0;
       }
@@ -383,27 +1063,42 @@ private:
   //          with the same elements and EXACTLY the same structure as the
   //          tree rooted at 'node'.
   // NOTE:    This function must be tree recursive.
-  static Node *copy_nodes_impl(Node *node) {
+  static Node *copy_nodes_impl(Node *node, Node_pool &nodes) {
+    if constexpr (Kernels::iterative) {
+      return copy_nodes_loop_impl(node, nodes);
+    }
     if (!node) {
       return nullptr;
     }
-    return new Node(node->datum, copy_nodes_impl(node->left),
-    copy_nodes_impl(node->right));
+    Node *copy = nodes.create(node->datum, copy_nodes_impl(node->left, nodes),
+    copy_nodes_impl(node->right, nodes));
+    static_cast<typename Balance::node_data &>(*copy) = *node;
+    if (copy->left) {
+      copy->left->parent = copy;
+    }
+    if (copy->right) {
+      copy->right->parent = copy;
+    }
+    return copy;
   }
   // EFFECTS: Frees the memory for all nodes used in the tree rooted at 
   //          'node'.
   // NOTE:    This function must be tree recursive.
-  static void destroy_nodes_impl(Node *node) {
+  static void destroy_nodes_impl(Node *node, Node_pool &nodes) {
+    if constexpr (Kernels::iterative) {
+      destroy_nodes_loop_impl(node, nodes);
+      return;
+    }
     if (!node) {
       return;
     }
     if (node->left != nullptr) {
-      destroy_nodes_impl(node->left);
+      destroy_nodes_impl(node->left, nodes);
     }
     if (node->right != nullptr) {
-      destroy_nodes_impl(node->right);
+      destroy_nodes_impl(node->right, nodes);
     }
-    delete node;
+    nodes.destroy(node);
   }
 
   // EFFECTS : Searches the tree rooted at 'node' for an element equivalent
@@ -418,7 +1113,11 @@ private:
   //       parameter to compare elements.
   //       Two elements A and B are equivalent if and only if A is
   //       not less than B and B is not less than A.
-  static Node * find_impl(Node *node, const T &query, Compare less) {
+  template <typename Query>
+  static Node * find_impl(Node *node, const Query &query, Compare less) {
+    if constexpr (Kernels::iterative) {
+      return find_loop_impl(node, query, less);
+    }
     if (!node || (!less(node->datum, query) && !less(query, node->datum))) {
     return node;
     }
@@ -430,33 +1129,439 @@ private:
     return node;
   }
 
-  // REQUIRES: item is not already contained in the tree rooted at 'node'
   // MODIFIES: the tree rooted at 'node'
-  // EFFECTS : If 'node' represents an empty tree, allocates a new
-  //           Node to represent a single-element tree with 'item' as
-  //           its only element and returns a pointer to the new Node.
-  //           If the tree rooted at 'node' is not empty, inserts
-  //           'item' into the proper location as a leaf in the
-  //           existing tree structure according to the sorting
-  //           invariant and returns the original parameter 'node'.
+  // EFFECTS : If the tree rooted at 'node' holds an element equivalent to
+  //           'query', sets 'result' to its node and returns 'node'
+  //           unchanged. Otherwise allocates a new Node holding make() as a
+  //           leaf in the proper location according to the sorting
+  //           invariant, sets 'result' to it, sets 'inserted' to true and
+  //           returns the (possibly new) root of the subtree.
   // NOTE: This function must be linear recursive, but does not
   //       need to be tail recursive.
   // HINT: Element ordering is defined according to the Compare functor
   //       associated with this instantiation of the BinarySearchTree
   //       template, NOT according to the < operator. Use the "less"
   //       parameter to compare elements.
-  static Node * insert_impl(Node *node, const T &item, Compare less) {
+  //       On the way back up, each node on the path is handed to the
+  //       balancing policy, which may rotate it; nothing on the path
+  //       changes when the element was already present.
+  template <typename Query, typename Make>
+  static Node * insert_impl(Node *node, const Query &query, Make &make,
+                            Compare less, Node_pool &nodes, Node *&result,
+                            bool &inserted) {
+    if constexpr (Kernels::iterative) {
+      return insert_loop_impl(node, query, make, less, nodes, result,
+                              inserted);
+    }
     if (!node) {
-      return new Node(item, nullptr, nullptr);
+      result = nodes.create(make(), nullptr, nullptr);
+      inserted = true;
+      return result;
     }
-    else if (less(item, node->datum)) {
-      node->left = insert_impl(node->left, item, less);
-    } else {
-      node->right = insert_impl(node->right, item, less);
+    else if (less(query, node->datum)) {
+      node->left = insert_impl(node->left, query, make, less, nodes, result,
+                               inserted);
+      node->left->parent = node;
+    }
+    else if (less(node->datum, query)) {
+      node->right = insert_impl(node->right, query, make, less, nodes,
+                                result, inserted);
+      node->right->parent = node;
+    }
+    else {
+      result = node;
+      return node;
     }
+    if (!inserted) {
+      return node;
+    }
+    update_size_impl(node);
+    return Balance::template rebalance<Rotations>(node);
+  }
+
+  // REQUIRES: the n elements starting at 'first' are in increasing order
+  //           and greater than *prev, if prev is not null
+  // MODIFIES: first, prev
+  // EFFECTS : Builds a tree of minimal height from the next n elements,
+  //           advancing 'first' past them, and returns its root. prev is
+  //           left pointing at the last element placed.
+  // NOTE: This function must be tree recursive. Elements are taken in
+  //       order: the left half, then the middle element as the root, then
+  //       the right half. Every such tree also meets the AVL invariant.
+  template <typename Iter>
+  static Node * build_sorted_impl(Iter &first, size_t n, Node_pool &nodes,
+                                  Compare less, const T *&prev) {
+    if (n == 0) {
+      return nullptr;
+    }
+    Node *left = build_sorted_impl(first, n / 2, nodes, less, prev);
+    Node *node = nodes.create(*first, left, nullptr);
+    ++first;
+    assert(!prev || less(*prev, node->datum));
+    prev = &node->datum;
+    node->right = build_sorted_impl(first, n - n / 2 - 1, nodes, less, prev);
+    if (node->left) {
+      node->left->parent = node;
+    }
+    if (node->right) {
+      node->right->parent = node;
+    }
+    update_size_impl(node);
+    Balance::update(node);
     return node;
   }
 
+  // EFFECTS: Returns a pointer to the node holding the first element in
+  //          the tree rooted at 'node' that is not less than 'value', or a
+  //          null pointer if there is none.
+  template <typename Query>
+  static Node * lower_bound_impl(Node *node, const Query &value,
+                                 Compare less) {
+    Node *best = nullptr;
+    while (node) {
+      if (less(node->datum, value)) {
+        node = node->right;
+      }
+      else {
+        best = node;
+        node = node->left;
+      }
+    }
+    return best;
+  }
+
+  // EFFECTS: Returns a pointer to the node holding the first element in
+  //          the tree rooted at 'node' that 'value' is less than, or a null
+  //          pointer if there is none.
+  template <typename Query>
+  static Node * upper_bound_impl(Node *node, const Query &value,
+                                 Compare less) {
+    Node *best = nullptr;
+    while (node) {
+      if (less(value, node->datum)) {
+        best = node;
+        node = node->left;
+      }
+      else {
+        node = node->right;
+      }
+    }
+    return best;
+  }
+
+  // ITERATIVE KERNELS
+  // Loop-based counterparts of the kernels above, used under bst_iterative.
+  // Each has the same EFFECTS as the kernel it stands in for and runs in
+  // constant stack space.
+
+  // EFFECTS: Same as height_impl.
+  // NOTE:    Walks the tree in pre-order through the parent links, keeping
+  //          the depth of the current node.
+  static int height_loop_impl(const Node *node) {
+    if (!node) {
+      return 0;
+    }
+    const Node *top = node;
+    int depth = 1;
+    int height = 1;
+    while (true) {
+      if (node->left || node->right) {
+        node = node->left ? node->left : node->right;
+        ++depth;
+        if (depth > height) {
+          height = depth;
+        }
+        continue;
+      }
+      // At a leaf: climb to the closest ancestor with an unvisited right
+      // subtree, and step into it.
+      while (node != top &&
+             (node == node->parent->right || !node->parent->right)) {
+        node = node->parent;
+        --depth;
+      }
+      if (node == top) {
+        return height;
+      }
+      node = node->parent->right;
+    }
+  }
+
+  // MODIFIES: stats
+  // EFFECTS : Counts the nodes of the tree rooted at node into stats.nodes,
+  //           stats.max_depth and stats.depth_histogram, and returns the
+  //           sum of their depths.
+  // NOTE    : Walks the tree in pre-order through the parent links, like
+  //           height_loop_impl, under either Kernels policy.
+  static size_t stats_impl(const Node *node, bst_stats &stats) {
+    if (!node) {
+      return 0;
+    }
+    const Node *top = node;
+    size_t depth = 0;
+    size_t depth_sum = 0;
+    while (true) {
+      ++stats.nodes;
+      depth_sum += depth;
+      if (depth > stats.max_depth) {
+        stats.max_depth = depth;
+      }
+      ++stats.depth_histogram[depth < bst_stats::histogram_buckets
+                              ? depth : bst_stats::histogram_buckets - 1];
+      if (node->left || node->right) {
+        node = node->left ? node->left : node->right;
+        ++depth;
+        continue;
+      }
+      // At a leaf: climb to the closest ancestor with an unvisited right
+      // subtree, and step into it.
+      while (node != top &&
+             (node == node->parent->right || !node->parent->right)) {
+        node = node->parent;
+        --depth;
+      }
+      if (node == top) {
+        return depth_sum;
+      }
+      node = node->parent->right;
+    }
+  }
+
+  // EFFECTS: Same as copy_nodes_impl.
+  // NOTE:    Walks the source in pre-order through the parent links,
+  //          creating each copy before its children.
+  static Node *copy_nodes_loop_impl(Node *node, Node_pool &nodes) {
+    if (!node) {
+      return nullptr;
+    }
+    const Node *top = node;
+    Node *copy_top = copy_one_node(node, nodes);
+    Node *copy = copy_top;
+    while (true) {
+      if (node->left && !copy->left) {
+        copy->left = copy_one_node(node->left, nodes);
+        copy->left->parent = copy;
+        node = node->left;
+        copy = copy->left;
+      }
+      else if (node->right && !copy->right) {
+        copy->right = copy_one_node(node->right, nodes);
+        copy->right->parent = copy;
+        node = node->right;
+        copy = copy->right;
+      }
+      else if (node == top) {
+        return copy_top;
+      }
+      else {
+        node = node->parent;
+        copy = copy->parent;
+      }
+    }
+  }
+
+  // EFFECTS: Returns a new childless node with the element, subtree size
+  //          and balancing data of 'node'.
+  static Node *copy_one_node(const Node *node, Node_pool &nodes) {
+    Node *copy = nodes.create(node->datum, nullptr, nullptr);
+    static_cast<typename Balance::node_data &>(*copy) = *node;
+    copy->subtree_size = node->subtree_size;
+    return copy;
+  }
+
+  // EFFECTS: Same as destroy_nodes_impl.
+  // NOTE:    Descends to a leaf, frees it and unhooks it from its parent,
+  //          then continues from the parent, so every edge is walked down
+  //          and up once.
+  static void destroy_nodes_loop_impl(Node *node, Node_pool &nodes) {
+    if (!node) {
+      return;
+    }
+    Node *stop = node->parent;
+    while (node != stop) {
+      if (node->left) {
+        node = node->left;
+      }
+      else if (node->right) {
+        node = node->right;
+      }
+      else {
+        Node *parent = node->parent;
+        if (parent != stop) {
+          (parent->left == node ? parent->left : parent->right) = nullptr;
+        }
+        nodes.destroy(node);
+        node = parent;
+      }
+    }
+  }
+
+  // EFFECTS: Same as find_impl.
+  template <typename Query>
+  static Node * find_loop_impl(Node *node, const Query &query, Compare less) {
+    while (node) {
+      if (less(query, node->datum)) {
+        node = node->left;
+      }
+      else if (less(node->datum, query)) {
+        node = node->right;
+      }
+      else {
+        return node;
+      }
+    }
+    return nullptr;
+  }
+
+  // REQUIRES: 'node' is the root of the whole tree (it has no parent)
+  // EFFECTS : Same as insert_impl.
+  // NOTE    : Descends once to find the element or the leaf position for
+  //           it, then climbs the parent links to the root, updating
+  //           subtree sizes and handing each node to the balancing policy.
+  template <typename Query, typename Make>
+  static Node * insert_loop_impl(Node *node, const Query &query, Make &make,
+                                 Compare less, Node_pool &nodes,
+                                 Node *&result, bool &inserted) {
+    Node *parent = nullptr;
+    bool go_left = false;
+    for (Node *cur = node; cur; ) {
+      parent = cur;
+      if (less(query, cur->datum)) {
+        go_left = true;
+        cur = cur->left;
+      }
+      else if (less(cur->datum, query)) {
+        go_left = false;
+        cur = cur->right;
+      }
+      else {
+        result = cur;
+        return node;
+      }
+    }
+    result = nodes.create(make(), nullptr, nullptr);
+    inserted = true;
+    if (!parent) {
+      return result;
+    }
+    result->parent = parent;
+    (go_left ? parent->left : parent->right) = result;
+    return fix_path_impl(parent, node);
+  }
+
+  // REQUIRES: the path from 'node' to the root of the tree, whose current
+  //           root is 'root', is the only one whose subtree sizes or
+  //           balance may be off
+  // EFFECTS : Climbs from 'node' to the root, recomputing subtree sizes and
+  //           handing each node to the balancing policy, and returns the
+  //           (possibly new) root of the tree. A null 'node' leaves the
+  //           tree as it is.
+  static Node * fix_path_impl(Node *node, Node *root) {
+    while (node) {
+      Node *up = node->parent;
+      bool was_left = up && up->left == node;
+      update_size_impl(node);
+      Node *sub = Balance::template rebalance<Rotations>(node);
+      if (!up) {
+        root = sub;
+      }
+      else {
+        (was_left ? up->left : up->right) = sub;
+      }
+      node = up;
+    }
+    return root;
+  }
+
+  // MODIFIES: the tree rooted at 'root'
+  // EFFECTS : Puts 'replacement' (possibly null) where 'node' hangs from
+  //           its parent and returns the (possibly new) root.
+  static Node * replace_child_impl(Node *root, Node *node,
+                                   Node *replacement) {
+    Node *parent = node->parent;
+    if (replacement) {
+      replacement->parent = parent;
+    }
+    if (!parent) {
+      return replacement;
+    }
+    (parent->left == node ? parent->left : parent->right) = replacement;
+    return root;
+  }
+
+  // REQUIRES: 'node' is in the tree rooted at 'root'
+  // MODIFIES: the tree rooted at 'root'
+  // EFFECTS : Unlinks 'node' from the tree, without freeing it, and returns
+  //           the (possibly new) root. A node with two children is replaced
+  //           by its successor, which is moved (not copied) into its place.
+  //           Subtree sizes and balance are then restored from the lowest
+  //           changed node up.
+  static Node * erase_impl(Node *root, Node *node) {
+    Node *fix_from;
+    if (!node->left || !node->right) {
+      fix_from = node->parent;
+      root = replace_child_impl(root, node,
+                                node->left ? node->left : node->right);
+    }
+    else {
+      Node *succ = min_element_impl(node->right);
+      if (succ->parent != node) {
+        fix_from = succ->parent;
+        root = replace_child_impl(root, succ, succ->right);
+        succ->right = node->right;
+        succ->right->parent = succ;
+      }
+      else {
+        fix_from = succ;
+      }
+      root = replace_child_impl(root, node, succ);
+      succ->left = node->left;
+      succ->left->parent = succ;
+      static_cast<typename Balance::node_data &>(*succ) = *node;
+    }
+    return fix_path_impl(fix_from, root);
+  }
+
+  // Rotations used by the balancing policy. Each takes the root of a
+  // subtree and returns the new root, keeping the sorting invariant and
+  // all parent links; the new root inherits the old root's parent.
+  struct Rotations {
+    // Makes node's right child the subtree root, with node as its left
+    // child and the child's former left subtree as node's right subtree.
+    static Node * rotate_left(Node *node) {
+      Node *r = node->right;
+      node->right = r->left;
+      if (node->right) {
+        node->right->parent = node;
+      }
+      r->left = node;
+      r->parent = node->parent;
+      node->parent = r;
+      update_size_impl(node);
+      update_size_impl(r);
+      Balance::update(node);
+      Balance::update(r);
+      return r;
+    }
+
+    // Mirror image of rotate_left.
+    static Node * rotate_right(Node *node) {
+      Node *l = node->left;
+      node->left = l->right;
+      if (node->left) {
+        node->left->parent = node;
+      }
+      l->right = node;
+      l->parent = node->parent;
+      node->parent = l;
+      update_size_impl(node);
+      update_size_impl(l);
+      Balance::update(node);
+      Balance::update(l);
+      return l;
+    }
+  };
+
   // EFFECTS : Returns a pointer to the Node containing the minimum element
   //           in the tree rooted at 'node' or a null pointer if the tree is 
   //           empty.
@@ -466,6 +1571,12 @@ private:
   // HINT: You don't need to compare any elements! Think about the
   //       structure, and where the smallest element lives.
   static Node * min_element_impl(Node *node) {
+    if constexpr (Kernels::iterative) {
+      while (node && node->left) {
+        node = node->left;
+      }
+      return node;
+    }
     // returns nullptr if tree is empty
     if (!node) {
       return nullptr;
@@ -485,6 +1596,12 @@ private:
   // HINT: You don't need to compare any elements! Think about the
   //       structure, and where the largest element lives.
   static Node * max_element_impl(Node *node) {
+    if constexpr (Kernels::iterative) {
+      while (node && node->right) {
+        node = node->right;
+      }
+      return node;
+    }
     // returns nullptr if tree is empty
     if (!node) {
       return nullptr;
@@ -573,26 +1690,22 @@ private:
   //           Returns a null pointer if the tree is empty or if it does not
   //           contain any elements that are greater than 'val'.
   //
-  // NOTE: This function must be linear recursive.
-  // NOTE: This function is used in the implementation of the ++ operator for
-  //       the iterator code that is provided for you.
-  // HINT: At each step, compare 'val' the the current node (using the
-  //       'less' parameter). Based on the result, you gain some information
-  //       about where the element you're looking for could be.
+  // NOTE: Walks down with a loop, remembering the last node that was
+  //       greater than 'val', so it runs in constant stack space at any
+  //       depth.
   static Node * min_greater_than_impl(Node *node, const T &val, Compare less) {
-    if (!node) {
-        return nullptr;
-    }
-    if (less(val, node->datum)) {
-        Node* left_result = min_greater_than_impl(node->left, val, less);
-        if (left_result != nullptr) {
-            return left_result;
-        }
-        return node;
-    } else {
-        return min_greater_than_impl(node->right, val, less);
+    Node *best = nullptr;
+    while (node) {
+      if (less(val, node->datum)) {
+        best = node;
+        node = node->left;
+      }
+      else {
+        node = node->right;
+      }
     }
-}
+    return best;
+  }
 
 }; // END of BinarySearchTree class
 
@@ -611,9 +1724,11 @@ private:
 //           BinarySearchTree Iterator, which in turn depends on some
 //           of the functions you must write.
 
-template <typename T, typename Compare>
+template <typename T, typename Compare, typename Balance, typename Alloc,
+          typename Kernels>
 std::ostream &operator<<(std::ostream &os,
-                         const BinarySearchTree<T, Compare> &tree) {
+                         const BinarySearchTree<T, Compare, Balance, Alloc,
+                                                Kernels> &tree) {
 // DO NOT CHANGE THE IMPLEMENTATION OF THIS FUNCTION
   os << "[ ";
   for (T& elt : tree) {
@@ -0,0 +1,241 @@
+#ifndef CONCURRENT_MAP_HPP
+#define CONCURRENT_MAP_HPP
+/* ConcurrentMap.hpp
+ *
+ * A Map that any number of reader threads can search and iterate without
+ * locks while a writer keeps updating it.
+ *
+ * The contents are a series of immutable versions, each a Map over a
+ * PersistentTree. A write copies the current version (in constant time),
+ * changes the copy (copying only the paths it touches) and publishes it
+ * with an atomic store. Readers pin the version that is current when they
+ * start and see exactly that version until they unpin, however many
+ * writes happen meanwhile.
+ *
+ * Replaced versions are freed with epoch-based reclamation: a version
+ * retired in epoch e is freed once no reader is pinned in an epoch at or
+ * before e. Readers never wait; a pinned reader only delays the freeing.
+ *
+ *   ConcurrentMap<std::string, int> counts;
+ *
+ *   // writer thread
+ *   counts.update([](auto &m) { m["word"] += 1; m.erase("stale"); });
+ *
+ *   // each reader thread
+ *   ConcurrentMap<std::string, int>::Reader reader(counts);
+ *   {
+ *     auto version = reader.pin();
+ *     auto it = version->find("word");
+ *     ...
+ *   } // unpinned
+ */
+
+#include "Map.hpp"
+#include "PersistentTree.hpp"
+#include <atomic>    //atomic
+#include <cstdint>   //uint64_t
+#include <mutex>     //mutex, lock_guard
+#include <stdexcept> //runtime_error
+#include <vector>    //vector
+
+template <typename Key_type, typename Value_type,
+          typename Key_compare=std::less<Key_type> // default argument
+         >
+class ConcurrentMap {
+private:
+  // A reader's announcement, on its own cache line so that readers in
+  // different threads do not contend.
+  struct alignas(64) Slot {
+    std::atomic<bool> claimed{false};
+    std::atomic<uint64_t> epoch{0};  // 0 when not pinned
+  };
+
+public:
+  // One immutable version of the contents.
+  using Version = Map<Key_type, Value_type, Key_compare, PersistentTree>;
+
+  // The most readers that can be registered at once.
+  static constexpr int max_readers = 128;
+
+  // Default ctor: an empty map.
+  ConcurrentMap()
+    : current(new Version), epoch(1) { }
+
+  ConcurrentMap(const ConcurrentMap &) = delete;
+  ConcurrentMap &operator=(const ConcurrentMap &) = delete;
+
+  // REQUIRES: no Reader of this map is still alive
+  ~ConcurrentMap() {
+    delete current.load();
+    for (const Retired &r : retired) {
+      delete r.version;
+    }
+  }
+
+  class Reader;
+
+  // A pinned version. Valid until the Guard is destroyed.
+  class Guard {
+  public:
+    const Version &operator*() const {
+      return *version;
+    }
+
+    const Version *operator->() const {
+      return version;
+    }
+
+    ~Guard() {
+      slot->epoch.store(0, std::memory_order_release);
+    }
+
+    Guard(const Guard &) = delete;
+    Guard &operator=(const Guard &) = delete;
+
+  private:
+    friend class Reader;
+
+    Slot *slot;
+    const Version *version;
+
+    Guard(Slot *slot_in, const Version *version_in)
+      : slot(slot_in), version(version_in) { }
+  };
+
+  // OVERVIEW: A reader thread's registration with a ConcurrentMap. Each
+  //           thread that reads should own one Reader for as long as it
+  //           keeps reading; creating one claims one of max_readers slots.
+  class Reader {
+  public:
+    // EFFECTS: Registers a reader with map. Throws std::runtime_error if
+    //          max_readers Readers already exist.
+    explicit Reader(const ConcurrentMap &map_in)
+      : map(&map_in), slot(map_in.claim_slot()) { }
+
+    ~Reader() {
+      slot->claimed.store(false, std::memory_order_release);
+    }
+
+    Reader(const Reader &) = delete;
+    Reader &operator=(const Reader &) = delete;
+
+    // REQUIRES: no other Guard from this Reader is alive
+    // EFFECTS : Pins the current version and returns a Guard through which
+    //           it can be searched and iterated. Never blocks.
+    // NOTE    : Guards are returned by value via guaranteed copy elision.
+    Guard pin() const {
+      // Announce the epoch before loading the version, so that a writer
+      // that retires this version afterwards sees the announcement.
+      slot->epoch.store(map->epoch.load(std::memory_order_seq_cst),
+                        std::memory_order_seq_cst);
+      return Guard(slot, map->current.load(std::memory_order_seq_cst));
+    }
+
+  private:
+    const ConcurrentMap *map;
+    Slot *slot;
+  };
+
+  // MODIFIES: this
+  // EFFECTS : Calls f with a private copy of the current version, then
+  //           publishes the copy as the new current version and frees the
+  //           versions no reader can still see. Writers are serialized; f
+  //           should batch as many changes as it can, since each update
+  //           publishes one version.
+  template <typename F>
+  void update(F f) {
+    std::lock_guard<std::mutex> lock(write_mutex);
+    Version *old = current.load(std::memory_order_relaxed);
+    Version *next = new Version(*old);
+    try {
+      f(*next);
+    }
+    catch (...) {
+      delete next;
+      throw;
+    }
+    current.store(next, std::memory_order_seq_cst);
+    retired.push_back({ old, epoch.fetch_add(1, std::memory_order_seq_cst) });
+    reclaim_impl();
+  }
+
+  // MODIFIES: this
+  // EFFECTS : Sets the value for k to v, inserting k if needed, as one
+  //           update.
+  void insert_or_assign(const Key_type &k, const Value_type &v) {
+    update([&](Version &m) { m.insert_or_assign(k, v); });
+  }
+
+  // MODIFIES: this
+  // EFFECTS : Removes k, if present, as one update.
+  void erase(const Key_type &k) {
+    update([&](Version &m) { m.erase(k); });
+  }
+
+  // MODIFIES: this
+  // EFFECTS : Frees the replaced versions no reader can still see. update()
+  //           does this itself; call it to free them when readers have
+  //           finished and no more updates are coming.
+  void reclaim() {
+    std::lock_guard<std::mutex> lock(write_mutex);
+    reclaim_impl();
+  }
+
+  // EFFECTS: Returns the number of replaced versions not yet freed because
+  //          a reader may still see them.
+  size_t pending_versions() const {
+    std::lock_guard<std::mutex> lock(write_mutex);
+    return retired.size();
+  }
+
+private:
+  struct Retired {
+    Version *version;
+    uint64_t epoch;  // the epoch in which it stopped being current
+  };
+
+  std::atomic<Version *> current;
+  std::atomic<uint64_t> epoch;
+  mutable Slot slots[max_readers];
+
+  // Writer state.
+  mutable std::mutex write_mutex;
+  std::vector<Retired> retired;
+
+  Slot *claim_slot() const {
+    for (Slot &slot : slots) {
+      bool expected = false;
+      if (!slot.claimed.load(std::memory_order_relaxed) &&
+          slot.claimed.compare_exchange_strong(expected, true,
+                                               std::memory_order_acquire)) {
+        return &slot;
+      }
+    }
+    throw std::runtime_error("ConcurrentMap: too many readers");
+  }
+
+  // REQUIRES: write_mutex is held
+  // EFFECTS : Frees every retired version that was retired before the
+  //           oldest epoch any reader is pinned in.
+  void reclaim_impl() {
+    uint64_t oldest = epoch.load(std::memory_order_seq_cst);
+    for (const Slot &slot : slots) {
+      uint64_t e = slot.epoch.load(std::memory_order_seq_cst);
+      if (e != 0 && e < oldest) {
+        oldest = e;
+      }
+    }
+    size_t kept = 0;
+    for (const Retired &r : retired) {
+      if (r.epoch < oldest) {
+        delete r.version;
+      }
+      else {
+        retired[kept++] = r;
+      }
+    }
+    retired.resize(kept);
+  }
+};
+
+#endif
@@ -18,10 +18,34 @@
 
 #include "BinarySearchTree.hpp"
 #include <cassert>  //assert
-#include <utility>  //pair
+#include <utility>  //pair, move, forward, piecewise_construct
+#include <tuple>    //forward_as_tuple
+#include <string_view> //string_view
+
+// The default Tree argument of Map: a BinarySearchTree with every other
+// policy left at its default. Map's Tree parameter takes two arguments, and
+// BinarySearchTree has five, so it needs this alias to fit on compilers
+// without relaxed template template argument matching.
+template <typename T, typename Compare>
+using DefaultTree = BinarySearchTree<T, Compare>;
+
+// A BinarySearchTree that keeps itself balanced with the AVL policy, for use
+// as the Tree argument of Map when keys may arrive in sorted order:
+//   Map<std::string, int, std::less<std::string>, AvlTree> words;
+template <typename T, typename Compare>
+using AvlTree = BinarySearchTree<T, Compare, bst_avl>;
+
+// BinarySearchTrees whose nodes come from a per-tree pool, for large Maps
+// built once and dropped whole (see bst_node_pool).
+template <typename T, typename Compare>
+using PooledTree = BinarySearchTree<T, Compare, bst_unbalanced, bst_node_pool>;
+
+template <typename T, typename Compare>
+using PooledAvlTree = BinarySearchTree<T, Compare, bst_avl, bst_node_pool>;
 
 template <typename Key_type, typename Value_type,
-          typename Key_compare=std::less<Key_type> // default argument
+          typename Key_compare=std::less<Key_type>, // default argument
+          template <typename, typename> class Tree=DefaultTree
          >
 class Map {
 
@@ -39,9 +63,22 @@ private:
       bool operator()(const Pair_type& lhs, const Pair_type& rhs) const {
         return less(lhs.first, rhs.first);
     }
+
+      // Compare a bare key against a pair, so that the tree can be searched
+      // for a key without building a pair around it. K is Key_type, or
+      // anything a transparent Key_compare can compare with one.
+      template <typename K>
+      bool operator()(const K& lhs, const Pair_type& rhs) const {
+        return less(lhs, rhs.first);
+      }
+
+      template <typename K>
+      bool operator()(const Pair_type& lhs, const K& rhs) const {
+        return less(lhs.first, rhs);
+      }
   };
 
-  BinarySearchTree<Pair_type, PairComp> bst;
+  Tree<Pair_type, PairComp> bst;
 
 public:
 
@@ -61,7 +98,7 @@ public:
   // Type alias for iterator type. It is sufficient to use the Iterator
   // from BinarySearchTree<Pair_type> since it will yield elements of
   // Pair_type in the appropriate order for the Map.
-  using Iterator = typename BinarySearchTree<Pair_type, PairComp>::Iterator;
+  using Iterator = typename Tree<Pair_type, PairComp>::Iterator;
 
   // You should add in a default constructor, destructor, copy
   // constructor, and overloaded assignment operator, if appropriate.
@@ -76,6 +113,9 @@ public:
   // copy ctor
   Map(const Map& other) : bst(other.bst) {}
 
+  // move ctor: takes other's elements in constant time, leaving it empty
+  Map(Map&& other) noexcept : bst(std::move(other.bst)) {}
+
 
   // dtor
   ~Map() = default;
@@ -88,6 +128,20 @@ public:
     return *this;
   }
 
+  // move assignment: frees this Map's elements and takes other's
+  Map& operator=(Map &&other) noexcept {
+    if (this != &other) {
+      bst = std::move(other.bst);
+    }
+    return *this;
+  }
+
+  // MODIFIES: this, other
+  // EFFECTS : Exchanges the contents of the two Maps in constant time.
+  void swap(Map &other) noexcept {
+    bst.swap(other.bst);
+  }
+
   // EFFECTS : Returns whether this Map is empty.
   bool empty() const {
     return bst.empty();
@@ -99,15 +153,61 @@ public:
     return static_cast<size_t>(bst.size());
   }
 
+  // EFFECTS : Returns the shape of the underlying tree, as
+  //           BinarySearchTree::stats() does. Use stats().to_json(os) to
+  //           export it.
+  // NOTE    : Only available when Tree is BinarySearchTree.
+  bst_stats stats() const {
+    return bst.stats();
+  }
+
   // EFFECTS : Searches this Map for an element with a key equivalent
   //           to k and returns an Iterator to the associated value if found,
   //           otherwise returns an end Iterator.
   //
-  // HINT: Since Map is implemented using a BinarySearchTree that stores
-  //       (key, value) pairs, you'll need to construct a dummy value
-  //       using "Value_type()".
+  // NOTE: The tree compares k directly against the stored pairs, so no
+  //       dummy pair (or Value_type) is constructed.
   Iterator find(const Key_type& k) const {
-    return bst.find({k, Value_type()});
+    return bst.find(k);
+  }
+
+  // EFFECTS : Same as above, for any k that a transparent Key_compare
+  //           (one that defines is_transparent, such as std::less<>) can
+  //           compare with Key_type. A Map<std::string, V, std::less<>>
+  //           can be searched with a std::string_view or a const char *
+  //           without building a std::string.
+  template <typename K, typename C = Key_compare,
+            typename = typename C::is_transparent>
+  Iterator find(const K& k) const {
+    return bst.find(k);
+  }
+
+  // EFFECTS : Returns the number of elements with a key equivalent to k,
+  //           which is either 0 or 1.
+  size_t count(const Key_type& k) const {
+    return contains(k) ? 1 : 0;
+  }
+
+  // EFFECTS : Same as above, for keys of any type a transparent
+  //           Key_compare accepts.
+  template <typename K, typename C = Key_compare,
+            typename = typename C::is_transparent>
+  size_t count(const K& k) const {
+    return contains(k) ? 1 : 0;
+  }
+
+  // EFFECTS : Returns whether this Map has an element with a key
+  //           equivalent to k.
+  bool contains(const Key_type& k) const {
+    return find(k) != end();
+  }
+
+  // EFFECTS : Same as above, for keys of any type a transparent
+  //           Key_compare accepts.
+  template <typename K, typename C = Key_compare,
+            typename = typename C::is_transparent>
+  bool contains(const K& k) const {
+    return find(k) != end();
   }
 
 
@@ -128,16 +228,21 @@ public:
   //           is done.
   //
   // HINT: http://www.cplusplus.com/reference/map/map/operator[]/
+  //
+  // NOTE: Under BTree, later insertions and erasures may move elements
+  //       between nodes, which invalidates the returned reference. Under
+  //       BinarySearchTree it stays valid until its element is erased.
 
  Value_type& operator[](const Key_type& k) {
-    Iterator it = find(k);
-    if (it != end()) {
-      return it->second;
-    }
-    std::pair<Iterator, bool> result = insert({k, Value_type()});
-    return result.first->second;
+    return try_emplace(k).first->second;
  }
 
+  // MODIFIES: this
+  // EFFECTS : Same as above, but moves k into the Map if it is inserted.
+  Value_type& operator[](Key_type&& k) {
+    return try_emplace(std::move(k)).first->second;
+  }
+
 
   // MODIFIES: this
   // EFFECTS : Inserts the given element into this Map if the given key
@@ -148,18 +253,189 @@ public:
   //           an iterator to the newly inserted element, along with
   //           the value true.
   std::pair<Iterator, bool> insert(const Pair_type &val){
-    std::pair<Iterator, bool> result;
-    if (find(val.first) != end()) {
-      result.first = find(val.first);
-      result.second = false;
+    return bst.insert_unique(val.first,
+                             [&val]() -> const Pair_type & { return val; });
+  }
+
+  // MODIFIES: this
+  // EFFECTS : Same as above, but moves val into the Map if it is inserted.
+  //           val is left untouched if its key is already present.
+  std::pair<Iterator, bool> insert(Pair_type &&val){
+    return bst.insert_unique(val.first,
+                             [&val]() -> Pair_type && { return std::move(val); });
+  }
+
+  // MODIFIES: this
+  // EFFECTS : If k is not in this Map, inserts an element with key k and a
+  //           mapped value constructed from args, and returns an iterator
+  //           to it along with true. Otherwise returns an iterator to the
+  //           existing element along with false, and args are not used.
+  // NOTE    : Searches the tree once and builds the element in place; no
+  //           temporary key or value is created.
+  template <typename... Args>
+  std::pair<Iterator, bool> try_emplace(const Key_type& k, Args&&... args) {
+    return bst.insert_unique(k, [&]() {
+      return Pair_type(std::piecewise_construct, std::forward_as_tuple(k),
+                       std::forward_as_tuple(std::forward<Args>(args)...));
+    });
+  }
+
+  // MODIFIES: this
+  // EFFECTS : Same as above, but moves k into the Map if it is inserted.
+  template <typename... Args>
+  std::pair<Iterator, bool> try_emplace(Key_type&& k, Args&&... args) {
+    return bst.insert_unique(k, [&]() {
+      return Pair_type(std::piecewise_construct,
+                       std::forward_as_tuple(std::move(k)),
+                       std::forward_as_tuple(std::forward<Args>(args)...));
+    });
+  }
+
+  // MODIFIES: this
+  // EFFECTS : If k is not in this Map, inserts an element with key k and
+  //           mapped value obj and returns an iterator to it along with
+  //           true. Otherwise assigns obj to the existing mapped value and
+  //           returns an iterator to it along with false.
+  template <typename M>
+  std::pair<Iterator, bool> insert_or_assign(const Key_type& k, M&& obj) {
+    std::pair<Iterator, bool> result = bst.insert_unique(k, [&]() {
+      return Pair_type(k, std::forward<M>(obj));
+    });
+    if (!result.second) {
+      result.first->second = std::forward<M>(obj);
     }
-    else {
-      result.first = bst.insert(val);
-      result.second = true;
+    return result;
+  }
+
+  // MODIFIES: this
+  // EFFECTS : Same as above, but moves k into the Map if it is inserted.
+  template <typename M>
+  std::pair<Iterator, bool> insert_or_assign(Key_type&& k, M&& obj) {
+    std::pair<Iterator, bool> result = bst.insert_unique(k, [&]() {
+      return Pair_type(std::move(k), std::forward<M>(obj));
+    });
+    if (!result.second) {
+      result.first->second = std::forward<M>(obj);
     }
     return result;
   }
 
+  // REQUIRES: [first, last) is a forward range of key-value pairs whose
+  //           keys are in strictly increasing order
+  // MODIFIES: this
+  // EFFECTS : Replaces the contents of this Map with the pairs in
+  //           [first, last), building a tree of minimal height in linear
+  //           time. Useful for loading a table that was saved in order.
+  // NOTE    : Only available when Tree is BinarySearchTree.
+  template <typename Iter>
+  void assign_sorted(Iter first, Iter last) {
+    bst.assign_sorted(first, last);
+  }
+
+  // EFFECTS : Returns an iterator to the first element whose key is not
+  //           less than k, or an end iterator if there is none.
+  Iterator lower_bound(const Key_type& k) const {
+    return bst.lower_bound(k);
+  }
+
+  // EFFECTS : Same as above, for keys of any type a transparent
+  //           Key_compare accepts.
+  template <typename K, typename C = Key_compare,
+            typename = typename C::is_transparent>
+  Iterator lower_bound(const K& k) const {
+    return bst.lower_bound(k);
+  }
+
+  // EFFECTS : Returns an iterator to the first element whose key is
+  //           greater than k, or an end iterator if there is none.
+  Iterator upper_bound(const Key_type& k) const {
+    return bst.upper_bound(k);
+  }
+
+  // EFFECTS : Same as above, for keys of any type a transparent
+  //           Key_compare accepts.
+  template <typename K, typename C = Key_compare,
+            typename = typename C::is_transparent>
+  Iterator upper_bound(const K& k) const {
+    return bst.upper_bound(k);
+  }
+
+  // EFFECTS : Returns the range of elements with a key equivalent to k,
+  //           as {lower_bound(k), upper_bound(k)}. It holds at most one
+  //           element.
+  std::pair<Iterator, Iterator> equal_range(const Key_type& k) const {
+    return { lower_bound(k), upper_bound(k) };
+  }
+
+  // EFFECTS : Same as above, for keys of any type a transparent
+  //           Key_compare accepts.
+  template <typename K, typename C = Key_compare,
+            typename = typename C::is_transparent>
+  std::pair<Iterator, Iterator> equal_range(const K& k) const {
+    return { lower_bound(k), upper_bound(k) };
+  }
+
+  // REQUIRES: Key_type is a string type that can be built from a
+  //           std::string_view, and Key_compare orders keys
+  //           lexicographically by character, as std::less does
+  // EFFECTS : Returns the range of elements whose keys start with prefix.
+  //           Iterating over it takes O(log n + k) for k matches.
+  // NOTE    : The range ends at the first key not less than the smallest
+  //           string that sorts after every string with the prefix: the
+  //           prefix with trailing '\xff' characters dropped and its last
+  //           character incremented. A prefix made only of '\xff'
+  //           characters (or an empty one) extends to the end.
+  std::pair<Iterator, Iterator> prefix_range(std::string_view prefix) const {
+    Iterator first = lower_bound(Key_type(prefix));
+    size_t n = prefix.size();
+    while (n > 0 && static_cast<unsigned char>(prefix[n - 1]) == 0xff) {
+      --n;
+    }
+    if (n == 0) {
+      return { first, end() };
+    }
+    Key_type bound(prefix.substr(0, n));
+    bound[n - 1] =
+      static_cast<char>(static_cast<unsigned char>(bound[n - 1]) + 1);
+    return { first, lower_bound(bound) };
+  }
+
+  // MODIFIES: this
+  // EFFECTS : Removes the element with key k, if there is one, and returns
+  //           the number of elements removed (0 or 1).
+  size_t erase(const Key_type& k) {
+    return bst.erase(k);
+  }
+
+  // REQUIRES: pos is a valid, dereferenceable iterator into this Map
+  // MODIFIES: this
+  // EFFECTS : Removes the element at pos and returns an iterator to the
+  //           element after it. Iterators to other elements stay valid,
+  //           except under BTree, where erasing invalidates them all.
+  Iterator erase(Iterator pos) {
+    return bst.erase(pos);
+  }
+
+  // MODIFIES: this
+  // EFFECTS : Removes every element.
+  void clear() {
+    bst.clear();
+  }
+
+  // EFFECTS : Returns an iterator to the key-value pair whose key has
+  //           exactly k smaller keys in this Map, or an end iterator if
+  //           k >= size().
+  // NOTE    : Only available when Tree is BinarySearchTree.
+  Iterator nth(size_t k) const {
+    return bst.nth(k);
+  }
+
+  // EFFECTS : Returns the number of keys in this Map that are less than k.
+  // NOTE    : Only available when Tree is BinarySearchTree.
+  size_t rank(const Key_type& k) const {
+    return bst.rank(k);
+  }
+
   // EFFECTS : Returns an iterator to the first key-value pair in this Map.
   Iterator begin() const{
     return bst.begin();
@@ -169,6 +445,20 @@ public:
   Iterator end() const{
     return bst.end();
   }
+
+  // Type alias for iterating over the elements in descending key order.
+  using Reverse_iterator = typename Tree<Pair_type, PairComp>::Reverse_iterator;
+
+  // EFFECTS : Returns a reverse iterator to the last key-value pair in this
+  //           Map.
+  Reverse_iterator rbegin() const{
+    return bst.rbegin();
+  }
+
+  // EFFECTS : Returns a reverse iterator to "before-the-beginning".
+  Reverse_iterator rend() const{
+    return bst.rend();
+  }
 };
 
 // You may implement member functions below using an "out-of-line" definition
@@ -0,0 +1,91 @@
+#ifndef MAPPED_FILE_HPP
+#define MAPPED_FILE_HPP
+/* MappedFile.hpp
+ *
+ * A read-only view of a whole file, memory-mapped where the platform
+ * supports it and read into memory otherwise. Used by csvstream to scan
+ * CSV input in place and by the classifier to use a saved model in place.
+ */
+
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define MAPPED_FILE_HAVE_MMAP 1
+#endif
+
+class MappedFile {
+public:
+  // Opens and maps filename. When sequential is true, the kernel is told
+  // the file will be read front to back. Throws std::runtime_error if the
+  // file cannot be opened or mapped.
+  explicit MappedFile(const std::string &filename, bool sequential = false) {
+#ifdef MAPPED_FILE_HAVE_MMAP
+    int fd = open(filename.c_str(), O_RDONLY);
+    struct stat st;
+    if (fd == -1 || fstat(fd, &st) == -1) {
+      if (fd != -1) close(fd);
+      throw std::runtime_error("Error opening file: " + filename);
+    }
+    length = static_cast<size_t>(st.st_size);
+    if (length > 0) {
+      void *addr = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+      close(fd);
+      if (addr == MAP_FAILED) {
+        throw std::runtime_error("Error mapping file: " + filename);
+      }
+      if (sequential) madvise(addr, length, MADV_SEQUENTIAL);
+      bytes = static_cast<const char *>(addr);
+      mapped = true;
+      return;
+    }
+    close(fd);
+#else
+    (void)sequential;
+    std::ifstream in(filename, std::ios::binary);
+    if (!in) {
+      throw std::runtime_error("Error opening file: " + filename);
+    }
+    buffer.assign(std::istreambuf_iterator<char>(in),
+                  std::istreambuf_iterator<char>());
+    length = buffer.size();
+    if (length > 0) {
+      bytes = buffer.data();
+      return;
+    }
+#endif
+    // An empty file is an empty range that still has a valid address.
+    static const char empty = '\0';
+    bytes = &empty;
+  }
+
+  ~MappedFile() {
+#ifdef MAPPED_FILE_HAVE_MMAP
+    if (mapped) munmap(const_cast<char *>(bytes), length);
+#endif
+  }
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  // The file's bytes, valid for the lifetime of this MappedFile. Mapped
+  // files start on a page boundary and buffered ones on an allocation
+  // boundary, so both are aligned for any scalar type.
+  const char *begin() const { return bytes; }
+  const char *end() const { return bytes + length; }
+
+private:
+  const char *bytes = nullptr;
+  size_t length = 0;
+  bool mapped = false;
+  std::vector<char> buffer;
+};
+
+#endif
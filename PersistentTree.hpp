@@ -0,0 +1,666 @@
+#ifndef PERSISTENT_TREE_HPP
+#define PERSISTENT_TREE_HPP
+/* PersistentTree.hpp
+ *
+ * An ordered set of unique elements stored in an AVL tree whose nodes are
+ * shared between copies. Copying a PersistentTree takes constant time: the
+ * copy shares every node with the original. A later write to either tree
+ * copies only the nodes on the root-to-leaf path it changes (path
+ * copying); nodes no other tree can reach are updated in place. Each node
+ * counts the trees and parent nodes that refer to it and is freed when the
+ * last of them lets go.
+ *
+ * Offers the part of the BinarySearchTree interface that Map relies on, so
+ * it can be used as Map's Tree argument to make Map snapshots cheap:
+ *   Map<std::string, int, std::less<std::string>, PersistentTree> model;
+ *   auto snapshot = model;   // O(1)
+ *   model["word"] += 1;      // copies O(log n) nodes; snapshot unchanged
+ *
+ * Reference counts are atomic, so a snapshot may be handed to another
+ * thread and read or destroyed there while the original keeps changing.
+ * As with any container, one tree object must not be written by one thread
+ * while another thread uses that same object.
+ *
+ * WARNING: Nodes reached through find, the bounds or iteration may be
+ *          shared with other trees, so elements must not be modified
+ *          through those iterators. The iterator returned by insert_unique
+ *          (which Map's operator[], try_emplace and insert_or_assign use)
+ *          points into nodes this tree owns alone and may be written
+ *          through. Any write invalidates all iterators into the tree.
+ */
+
+#include <atomic>     //atomic
+#include <cassert>    //assert
+#include <cstddef>    //size_t, ptrdiff_t
+#include <functional> //less
+#include <iterator>   //reverse_iterator, bidirectional_iterator_tag
+#include <utility>    //move, pair, swap
+
+template <typename T,
+          typename Compare=std::less<T> // default if argument isn't provided
+         >
+class PersistentTree {
+
+  // OVERVIEW: Elements are kept in sorted order as defined by Compare, and
+  //           no two elements are equivalent.
+  //
+  // INVARIANTS: The sorting invariant of BinarySearchTree, and the AVL
+  //             invariant: the heights of the two subtrees of any node
+  //             differ by at most one. A node's refs is the number of trees
+  //             and nodes pointing to it; a node with refs == 1 is reachable
+  //             from exactly one tree and may be changed in place.
+
+private:
+  struct Node {
+    T datum;
+    Node *left;
+    Node *right;
+    int height;
+    std::atomic<size_t> refs;
+
+    template <typename U>
+    Node(U &&datum_in, Node *left_in, Node *right_in, int height_in)
+      : datum(std::forward<U>(datum_in)), left(left_in), right(right_in),
+        height(height_in), refs(1) { }
+  };
+
+public:
+  // The deepest path iterators can hold. An AVL tree this tall would need
+  // more than 10^13 elements.
+  static constexpr int max_height = 64;
+
+  // Default constructor
+  PersistentTree() : root(nullptr), num_elements(0) { }
+
+  // Copy constructor
+  // Shares every node with other, in constant time.
+  PersistentTree(const PersistentTree &other)
+    : root(acquire(other.root)), num_elements(other.num_elements) { }
+
+  // Move constructor
+  PersistentTree(PersistentTree &&other) noexcept
+    : root(nullptr), num_elements(0) {
+    swap(other);
+  }
+
+  // Assignment operator
+  // Shares every node with rhs, in constant time.
+  PersistentTree &operator=(const PersistentTree &rhs) {
+    Node *old = root;
+    root = acquire(rhs.root);
+    num_elements = rhs.num_elements;
+    release(old);
+    return *this;
+  }
+
+  // Move assignment operator
+  PersistentTree &operator=(PersistentTree &&rhs) noexcept {
+    if (this != &rhs) {
+      clear();
+      swap(rhs);
+    }
+    return *this;
+  }
+
+  // Destructor
+  ~PersistentTree() {
+    release(root);
+  }
+
+  // MODIFIES: this PersistentTree, other
+  // EFFECTS : Exchanges the contents of the two trees in constant time.
+  void swap(PersistentTree &other) noexcept {
+    std::swap(root, other.root);
+    std::swap(num_elements, other.num_elements);
+    std::swap(less, other.less);
+  }
+
+  // MODIFIES: this PersistentTree
+  // EFFECTS : Removes every element. Nodes still shared with other trees
+  //           stay alive for them.
+  void clear() {
+    release(root);
+    root = nullptr;
+    num_elements = 0;
+  }
+
+  // EFFECTS: Returns whether this PersistentTree is empty.
+  bool empty() const {
+    return root == nullptr;
+  }
+
+  // EFFECTS: Returns the number of elements in this PersistentTree.
+  size_t size() const {
+    return num_elements;
+  }
+
+  // EFFECTS: Returns the height of the tree.
+  size_t height() const {
+    return static_cast<size_t>(height_of(root));
+  }
+
+  // EFFECTS: Returns whether the sorting invariant holds.
+  bool check_sorting_invariant() const {
+    const T *prev = nullptr;
+    for (const T &elt : *this) {
+      if (prev && !less(*prev, elt)) {
+        return false;
+      }
+      prev = &elt;
+    }
+    return true;
+  }
+
+  // EFFECTS: Returns whether the AVL invariant and the stored heights and
+  //          element count are correct.
+  bool check_balance_invariant() const {
+    size_t count = 0;
+    int h;
+    return check_impl(root, h, count) && count == num_elements;
+  }
+
+  class Iterator {
+    // OVERVIEW: Iterator interface for PersistentTree. Iterates over the
+    //           elements in ascending order. Iterators are bidirectional,
+    //           and decrementing an end iterator yields the last element.
+    //           Nodes have no parent links (a shared node has many
+    //           parents), so an iterator carries the path from the root to
+    //           its element.
+
+  public:
+    using iterator_category = std::bidirectional_iterator_tag;
+    using value_type = T;
+    using difference_type = std::ptrdiff_t;
+    using pointer = T *;
+    using reference = T &;
+
+    Iterator()
+      : tree(nullptr), depth(0) { }
+
+    // WARNING: See the note at the top of this file before modifying an
+    //          element through an iterator.
+    T &operator*() const {
+      return path[depth - 1]->datum;
+    }
+
+    T *operator->() const {
+      return &path[depth - 1]->datum;
+    }
+
+    // Prefix ++
+    Iterator &operator++() {
+      Node *node = path[depth - 1];
+      if (node->right) {
+        push_leftmost(node->right);
+        return *this;
+      }
+      // Climb past every ancestor whose right subtree we are leaving.
+      Node *child = path[--depth];
+      while (depth > 0 && path[depth - 1]->right == child) {
+        child = path[--depth];
+      }
+      return *this;
+    }
+
+    // Prefix --
+    // REQUIRES: this is not an iterator to the first element.
+    Iterator &operator--() {
+      if (depth == 0) {
+        push_rightmost(tree->root);
+        return *this;
+      }
+      Node *node = path[depth - 1];
+      if (node->left) {
+        push_rightmost(node->left);
+        return *this;
+      }
+      Node *child = path[--depth];
+      while (depth > 0 && path[depth - 1]->left == child) {
+        child = path[--depth];
+      }
+      return *this;
+    }
+
+    // Postfix ++ (implemented in terms of prefix ++)
+    Iterator operator++(int) {
+      Iterator result(*this);
+      ++(*this);
+      return result;
+    }
+
+    // Postfix -- (implemented in terms of prefix --)
+    Iterator operator--(int) {
+      Iterator result(*this);
+      --(*this);
+      return result;
+    }
+
+    bool operator==(const Iterator &rhs) const {
+      return current() == rhs.current();
+    }
+
+    bool operator!=(const Iterator &rhs) const {
+      return current() != rhs.current();
+    }
+
+  private:
+    friend class PersistentTree;
+
+    const PersistentTree *tree;
+    Node *path[max_height];  // path[0] is the root; empty for end
+    int depth;
+
+    explicit Iterator(const PersistentTree *tree_in)
+      : tree(tree_in), depth(0) { }
+
+    Node *current() const {
+      return depth ? path[depth - 1] : nullptr;
+    }
+
+    void push(Node *node) {
+      assert(depth < max_height);
+      path[depth++] = node;
+    }
+
+    void push_leftmost(Node *node) {
+      for (; node; node = node->left) {
+        push(node);
+      }
+    }
+
+    void push_rightmost(Node *node) {
+      for (; node; node = node->right) {
+        push(node);
+      }
+    }
+  }; // PersistentTree::Iterator
+
+  // EFFECTS: Returns an iterator to the first element in this tree.
+  Iterator begin() const {
+    Iterator it(this);
+    it.push_leftmost(root);
+    return it;
+  }
+
+  // EFFECTS: Returns an iterator to past-the-end.
+  Iterator end() const {
+    return Iterator(this);
+  }
+
+  // Type alias for iterating in descending order.
+  using Reverse_iterator = std::reverse_iterator<Iterator>;
+
+  // EFFECTS: Returns a reverse iterator to the last element in this tree.
+  Reverse_iterator rbegin() const {
+    return Reverse_iterator(end());
+  }
+
+  // EFFECTS: Returns a reverse iterator to before-the-beginning.
+  Reverse_iterator rend() const {
+    return Reverse_iterator(begin());
+  }
+
+  // EFFECTS: Returns an Iterator to the minimum element, or an end
+  //          Iterator if the tree is empty.
+  Iterator min_element() const {
+    return begin();
+  }
+
+  // EFFECTS: Returns an Iterator to the maximum element, or an end
+  //          Iterator if the tree is empty.
+  Iterator max_element() const {
+    Iterator it(this);
+    it.push_rightmost(root);
+    return it;
+  }
+
+  // EFFECTS: Searches this tree for an element equivalent to query, which
+  //          may be of any type Compare accepts on either side of a T.
+  //          Returns an iterator to it if found, and an end iterator
+  //          otherwise.
+  template <typename Query>
+  Iterator find(const Query &query) const {
+    Iterator it(this);
+    for (Node *node = root; node; ) {
+      it.push(node);
+      if (less(query, node->datum)) {
+        node = node->left;
+      }
+      else if (less(node->datum, query)) {
+        node = node->right;
+      }
+      else {
+        return it;
+      }
+    }
+    return end();
+  }
+
+  Iterator find(const T &query) const {
+    return find<T>(query);
+  }
+
+  // EFFECTS: Returns an iterator to the first element that is not less
+  //          than value, or an end iterator if there is none.
+  template <typename Query>
+  Iterator lower_bound(const Query &value) const {
+    return bound([this, &value](const T &elt) { return less(elt, value); });
+  }
+
+  // EFFECTS: Returns an iterator to the first element that value is less
+  //          than, or an end iterator if there is none.
+  template <typename Query>
+  Iterator upper_bound(const Query &value) const {
+    return bound([this, &value](const T &elt) { return !less(value, elt); });
+  }
+
+  // REQUIRES: The given item is not already contained in this tree
+  // MODIFIES: this PersistentTree
+  // EFFECTS : Inserts item into this tree and returns an iterator to it.
+  Iterator insert(const T &item) {
+    std::pair<Iterator, bool> result =
+      insert_unique(item, [&item]() -> const T & { return item; });
+    assert(result.second);
+    return result.first;
+  }
+
+  // REQUIRES: The given item is not already contained in this tree
+  // MODIFIES: this PersistentTree
+  // EFFECTS : Same as above, but moves item into the tree.
+  Iterator insert(T &&item) {
+    std::pair<Iterator, bool> result =
+      insert_unique(item, [&item]() -> T && { return std::move(item); });
+    assert(result.second);
+    return result.first;
+  }
+
+  // MODIFIES: this PersistentTree
+  // EFFECTS : Searches for an element equivalent to query. If there is one,
+  //           returns an iterator to it and false. Otherwise inserts the
+  //           element make() returns, which must be equivalent to query,
+  //           and returns an iterator to it and true. make is called only
+  //           when inserting.
+  // NOTE    : Either way, every node on the path to the element is made
+  //           private to this tree first, so the element may be modified
+  //           through the returned iterator.
+  template <typename Query, typename Make>
+  std::pair<Iterator, bool> insert_unique(const Query &query, Make &&make) {
+    Node *node = nullptr;
+    bool inserted = false;
+    root = insert_impl(root, query, make, less, node, inserted);
+    if (inserted) {
+      ++num_elements;
+    }
+    return { iterator_to(node), inserted };
+  }
+
+  // MODIFIES: this PersistentTree
+  // EFFECTS : Removes the element equivalent to value, if there is one,
+  //           and returns the number of elements removed (0 or 1).
+  // NOTE    : Looks for the element first, so that nothing is unshared
+  //           when there is nothing to remove.
+  template <typename Query>
+  size_t erase(const Query &value) {
+    if (find(value) == end()) {
+      return 0;
+    }
+    root = erase_impl(root, value, less);
+    --num_elements;
+    return 1;
+  }
+
+  size_t erase(const T &value) {
+    return erase<T>(value);
+  }
+
+  // REQUIRES: pos is a valid, dereferenceable iterator into this tree
+  // MODIFIES: this PersistentTree
+  // EFFECTS : Removes the element at pos and returns an iterator to the
+  //           element after it.
+  // NOTE    : Works from a copy of the element. The erase may drop this
+  //           tree's hold on nodes along the path, and a snapshot in
+  //           another thread may then free them, so no element of the old
+  //           path is read once the erase has begun.
+  Iterator erase(Iterator pos) {
+    const T erased = *pos;
+    erase<T>(erased);
+    return upper_bound(erased);
+  }
+
+private:
+  Node *root;
+  size_t num_elements;
+
+  // An instance of the Compare type. Use this to compare elements.
+  Compare less;
+
+  // EFFECTS: Adds a reference to node, if not null, and returns it.
+  static Node *acquire(Node *node) {
+    if (node) {
+      node->refs.fetch_add(1, std::memory_order_relaxed);
+    }
+    return node;
+  }
+
+  // EFFECTS: Drops a reference to node, if not null, freeing it (and
+  //          dropping its references to its children) if it was the last.
+  // NOTE:    This function is tree recursive, to a depth of at most the
+  //          height of the tree.
+  static void release(Node *node) {
+    if (node && node->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      release(node->left);
+      release(node->right);
+      delete node;
+    }
+  }
+
+  // EFFECTS: Returns a node equal to node that only the caller refers to:
+  //          node itself if it has no other references, and otherwise a
+  //          copy sharing node's children, with the caller's reference to
+  //          node moved to the copy.
+  static Node *unshare(Node *node) {
+    if (node->refs.load(std::memory_order_acquire) == 1) {
+      return node;
+    }
+    Node *copy = new Node(node->datum, acquire(node->left),
+                          acquire(node->right), node->height);
+    release(node);
+    return copy;
+  }
+
+  static int height_of(const Node *node) {
+    return node ? node->height : 0;
+  }
+
+  static void update(Node *node) {
+    int left = height_of(node->left);
+    int right = height_of(node->right);
+    node->height = 1 + (left > right ? left : right);
+  }
+
+  // REQUIRES: node is private to the caller
+  // EFFECTS : Rotates the subtree rooted at node and returns the new root.
+  //           The child that moves up is made private first; the subtree
+  //           that changes parent keeps its single reference.
+  static Node *rotate_left(Node *node) {
+    Node *r = unshare(node->right);
+    node->right = r->left;
+    r->left = node;
+    update(node);
+    update(r);
+    return r;
+  }
+
+  static Node *rotate_right(Node *node) {
+    Node *l = unshare(node->left);
+    node->left = l->right;
+    l->right = node;
+    update(node);
+    update(l);
+    return l;
+  }
+
+  // REQUIRES: node is private to the caller, and both of its subtrees meet
+  //           the AVL invariant with heights differing by at most two
+  // EFFECTS : Restores the AVL invariant at node and returns the subtree
+  //           root.
+  static Node *rebalance(Node *node) {
+    update(node);
+    int balance = height_of(node->left) - height_of(node->right);
+    if (balance > 1) {
+      if (height_of(node->left->left) < height_of(node->left->right)) {
+        node->left = rotate_left(unshare(node->left));
+      }
+      return rotate_right(node);
+    }
+    if (balance < -1) {
+      if (height_of(node->right->right) < height_of(node->right->left)) {
+        node->right = rotate_right(unshare(node->right));
+      }
+      return rotate_left(node);
+    }
+    return node;
+  }
+
+  // MODIFIES: the tree rooted at node, to which the caller holds one
+  //           reference
+  // EFFECTS : Like BinarySearchTree's insert_impl, returning the new root
+  //           of the subtree, in place of the caller's reference to node.
+  //           Every node on the search path is unshared on the way down.
+  // NOTE:    This function is linear recursive.
+  template <typename Query, typename Make>
+  static Node *insert_impl(Node *node, const Query &query, Make &make,
+                           Compare less, Node *&result, bool &inserted) {
+    if (!node) {
+      result = new Node(make(), nullptr, nullptr, 1);
+      inserted = true;
+      return result;
+    }
+    node = unshare(node);
+    if (less(query, node->datum)) {
+      node->left = insert_impl(node->left, query, make, less, result,
+                               inserted);
+    }
+    else if (less(node->datum, query)) {
+      node->right = insert_impl(node->right, query, make, less, result,
+                                inserted);
+    }
+    else {
+      result = node;
+      return node;
+    }
+    return inserted ? rebalance(node) : node;
+  }
+
+  // MODIFIES: node, to which the caller holds one reference
+  // EFFECTS : Detaches the minimum node of the subtree rooted at node,
+  //           setting min to it (private to the caller, with no children),
+  //           and returns the rest of the subtree.
+  // NOTE:    This function is linear recursive.
+  static Node *detach_min(Node *node, Node *&min) {
+    node = unshare(node);
+    if (!node->left) {
+      min = node;
+      Node *rest = node->right;
+      node->right = nullptr;
+      return rest;
+    }
+    node->left = detach_min(node->left, min);
+    return rebalance(node);
+  }
+
+  // REQUIRES: the subtree rooted at node, to which the caller holds one
+  //           reference, has an element equivalent to value
+  // MODIFIES: the tree rooted at node
+  // EFFECTS : Removes that element and returns the new root of the subtree,
+  //           in place of the caller's reference to node. The nodes above
+  //           it are unshared on the way down. A node with two children is
+  //           replaced by the minimum node of its right subtree, which is
+  //           relinked rather than copied when it is not shared.
+  // NOTE:    This function is linear recursive.
+  template <typename Query>
+  static Node *erase_impl(Node *node, const Query &value, Compare less) {
+    if (less(value, node->datum)) {
+      node = unshare(node);
+      node->left = erase_impl(node->left, value, less);
+      return rebalance(node);
+    }
+    if (less(node->datum, value)) {
+      node = unshare(node);
+      node->right = erase_impl(node->right, value, less);
+      return rebalance(node);
+    }
+    // Take references to the children, then drop the one to node; if node
+    // was private, that frees it and hands its references back.
+    Node *left = acquire(node->left);
+    Node *right = acquire(node->right);
+    release(node);
+    if (!right) {
+      return left;
+    }
+    if (!left) {
+      return right;
+    }
+    Node *min;
+    right = detach_min(right, min);
+    min->left = left;
+    min->right = right;
+    return rebalance(min);
+  }
+
+  // REQUIRES: before is true for a prefix of the elements in order
+  // EFFECTS : Returns an iterator to the first element for which before is
+  //           false, or an end iterator if there is none.
+  template <typename Pred>
+  Iterator bound(Pred before) const {
+    Iterator it(this);
+    int best = 0;
+    for (Node *node = root; node; ) {
+      it.push(node);
+      if (before(node->datum)) {
+        node = node->right;
+      }
+      else {
+        best = it.depth;
+        node = node->left;
+      }
+    }
+    it.depth = best;
+    return it;
+  }
+
+  // REQUIRES: node is in this tree
+  // EFFECTS : Returns an iterator to node, found by its element.
+  Iterator iterator_to(Node *target) const {
+    Iterator it(this);
+    for (Node *node = root; ; ) {
+      it.push(node);
+      if (node == target) {
+        return it;
+      }
+      node = less(target->datum, node->datum) ? node->left : node->right;
+    }
+  }
+
+  // EFFECTS: Returns whether the AVL invariant and stored heights are
+  //          correct in the subtree rooted at node, setting h to its
+  //          height and adding its size to count.
+  // NOTE:    This function is tree recursive.
+  static bool check_impl(const Node *node, int &h, size_t &count) {
+    if (!node) {
+      h = 0;
+      return true;
+    }
+    int left, right;
+    if (!check_impl(node->left, left, count) ||
+        !check_impl(node->right, right, count)) {
+      return false;
+    }
+    ++count;
+    h = 1 + (left > right ? left : right);
+    return node->height == h && left - right <= 1 && right - left <= 1 &&
+      node->refs.load(std::memory_order_relaxed) >= 1;
+  }
+};
+
+#endif
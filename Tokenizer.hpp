@@ -0,0 +1,202 @@
+#ifndef TOKENIZER_HPP
+#define TOKENIZER_HPP
+/* Tokenizer.hpp
+ *
+ * Splits post content into the set of distinct, normalized words used by
+ * the classifier. A word is a run of non-whitespace characters, with ASCII
+ * letters lowercased and ASCII punctuation removed; words that end up empty
+ * are dropped. This matches reading with operator>> and applying ::tolower
+ * and ::ispunct in the "C" locale.
+ *
+ * A Tokenizer owns a scratch buffer and a small open-addressing set that are
+ * reused between calls, so once they have grown to fit the longest post
+ * seen, tokenizing a post performs no heap allocations.
+ */
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+
+class Tokenizer {
+public:
+  Tokenizer() : epoch(0) {}
+
+  // EFFECTS: Returns the distinct normalized words in content, in order of
+  //          first appearance. The views point into this Tokenizer's
+  //          scratch buffer and are valid until the next call.
+  const std::vector<std::string_view> &unique_words(std::string_view content);
+
+private:
+  enum CharClass : unsigned char { KEEP, SPACE, PUNCT };
+
+  struct Tables {
+    unsigned char cls[256];
+    unsigned char lower[256];
+    Tables();
+  };
+
+  static const Tables tables;
+
+  // Normalized bytes of the current post; tokens are views into it.
+  std::string scratch;
+
+  // Distinct tokens of the current post.
+  std::vector<std::string_view> tokens;
+
+  // Open-addressing set of indices into tokens. A slot is occupied only
+  // when its stamp equals the current epoch, so clearing the set is a
+  // single increment.
+  std::vector<uint32_t> slots;
+  std::vector<uint32_t> stamps;
+  uint32_t epoch;
+
+  void reset(size_t max_tokens);
+  void add_token(size_t begin, size_t end, uint64_t hash);
+};
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Implementation
+
+inline Tokenizer::Tables::Tables() {
+  for (int c = 0; c < 256; ++c) {
+    cls[c] = KEEP;
+    lower[c] = static_cast<unsigned char>(c);
+  }
+  for (int c = 'A'; c <= 'Z'; ++c) {
+    lower[c] = static_cast<unsigned char>(c - 'A' + 'a');
+  }
+  for (int c = '\t'; c <= '\r'; ++c) {
+    cls[c] = SPACE;
+  }
+  cls[static_cast<unsigned char>(' ')] = SPACE;
+  for (const char *p = "!\"#$%&'()*+,-./:;<=>?@[\\]^_`{|}~"; *p; ++p) {
+    cls[static_cast<unsigned char>(*p)] = PUNCT;
+  }
+}
+
+inline const Tokenizer::Tables Tokenizer::tables;
+
+
+inline void Tokenizer::reset(size_t max_tokens) {
+  tokens.clear();
+
+  // Keep the load factor at or below one half.
+  size_t capacity = 16;
+  while (capacity < 2 * max_tokens) {
+    capacity *= 2;
+  }
+  if (capacity > slots.size()) {
+    slots.assign(capacity, 0);
+    stamps.assign(capacity, 0);
+    epoch = 0;
+  }
+
+  ++epoch;
+  if (epoch == 0) {
+    // The epoch wrapped around, so old stamps could look current.
+    stamps.assign(stamps.size(), 0);
+    epoch = 1;
+  }
+}
+
+
+inline void Tokenizer::add_token(size_t begin, size_t end, uint64_t hash) {
+  std::string_view token(scratch.data() + begin, end - begin);
+  size_t mask = slots.size() - 1;
+  for (size_t i = hash & mask; ; i = (i + 1) & mask) {
+    if (stamps[i] != epoch) {
+      stamps[i] = epoch;
+      slots[i] = static_cast<uint32_t>(tokens.size());
+      tokens.push_back(token);
+      return;
+    }
+    if (tokens[slots[i]] == token) {
+      return;
+    }
+  }
+}
+
+
+inline const std::vector<std::string_view> &
+Tokenizer::unique_words(std::string_view content) {
+  // Normalizing never lengthens the input, so one resize up front keeps
+  // every view into scratch stable for the whole call.
+  if (scratch.size() < content.size()) {
+    scratch.resize(content.size());
+  }
+  reset(content.size() / 2 + 1);
+
+  const unsigned char *in =
+    reinterpret_cast<const unsigned char *>(content.data());
+  const size_t n = content.size();
+  char *out = &scratch[0];
+  size_t len = 0;          // bytes written to scratch
+  size_t token_begin = 0;  // offset in scratch of the current token
+  const uint64_t fnv_basis = 14695981039346656037ull;
+  const uint64_t fnv_prime = 1099511628211ull;
+  uint64_t hash = fnv_basis;
+
+  size_t i = 0;
+  while (i < n) {
+#if defined(__SSE2__)
+    // Fast path: a block with no whitespace or punctuation only needs its
+    // uppercase letters lowered before being appended to the current token.
+    if (n - i >= 16) {
+      __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i));
+      auto in_range = [v](char lo, char hi) {
+        return _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(lo - 1)),
+                             _mm_cmplt_epi8(v, _mm_set1_epi8(hi + 1)));
+      };
+      __m128i special = _mm_or_si128(
+        _mm_or_si128(in_range('\t', '\r'), in_range(' ', '/')),
+        _mm_or_si128(_mm_or_si128(in_range(':', '@'), in_range('[', '`')),
+                     in_range('{', '~')));
+      if (_mm_movemask_epi8(special) == 0) {
+        __m128i upper = in_range('A', 'Z');
+        v = _mm_or_si128(v, _mm_and_si128(upper, _mm_set1_epi8(0x20)));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + len), v);
+        for (size_t k = 0; k < 16; ++k) {
+          hash = (hash ^ static_cast<unsigned char>(out[len + k])) * fnv_prime;
+        }
+        len += 16;
+        i += 16;
+        continue;
+      }
+    }
+#endif
+    // Scalar path, one byte at a time for at most one block.
+    size_t stop = (n - i >= 16) ? i + 16 : n;
+    for (; i < stop; ++i) {
+      unsigned char c = in[i];
+      switch (tables.cls[c]) {
+      case KEEP:
+        out[len++] = static_cast<char>(tables.lower[c]);
+        hash = (hash ^ tables.lower[c]) * fnv_prime;
+        break;
+      case PUNCT:
+        break;
+      case SPACE:
+        if (len > token_begin) {
+          add_token(token_begin, len, hash);
+        }
+        token_begin = len;
+        hash = fnv_basis;
+        break;
+      }
+    }
+  }
+  if (len > token_begin) {
+    add_token(token_begin, len, hash);
+  }
+  return tokens;
+}
+
+#endif
@@ -0,0 +1,691 @@
+// bench.cpp
+//
+// Benchmarks for the data structures, the CSV reader, the tokenizer and the
+// classifier as a whole. Everything runs on generated data, so no input
+// files or network access are needed.
+//
+// Each measurement is printed as one JSON object per line:
+//   {"suite":"tree","name":"insert","impl":"std::map","n":200000,
+//    "seconds":0.081,"rate":2.47e+06,"unit":"ops/s"}
+// where seconds is the best of --repeat runs and rate is n / seconds in the
+// given unit. The first line describes the run itself. Lines can be
+// collected from two builds and joined on suite, name and impl.
+//
+// Usage: benchmark [--size N] [--posts N] [--depth N] [--repeat N]
+//                  [--filter SUITE] [--classifier PATH]
+//   --size        elements per tree benchmark (default 200000)
+//   --posts       generated posts for the csv, tokenize and e2e suites
+//                 (default 50000)
+//   --depth       length of the degenerate chains in the deep suite
+//                 (default 20000); building one takes quadratic time
+//   --repeat      runs per measurement, keeping the fastest (default 3)
+//   --filter      only run suites whose name contains SUITE
+//                 (tree, deep, concurrent, stress, csv, tokenize, e2e)
+//   --classifier  the sentiment_classifier binary for the e2e suite; the
+//                 suite is skipped without it
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <string_view>
+#include <map>
+#include <random>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <limits>
+
+#include <unistd.h>
+
+#include "Map.hpp"
+#include "BTree.hpp"
+#include "PersistentTree.hpp"
+#include "ConcurrentMap.hpp"
+#include "csvstream.hpp"
+#include "Tokenizer.hpp"
+
+using namespace std;
+
+// AVL trees with the recursive kernels, to compare against the default
+// iterative ones.
+template <typename T, typename Compare>
+using RecursiveAvlTree =
+  BinarySearchTree<T, Compare, bst_avl, bst_new_delete, bst_recursive>;
+
+struct Options {
+  size_t size = 200000;
+  size_t posts = 50000;
+  size_t depth = 20000;
+  int repeat = 3;
+  string filter;
+  string classifier;
+};
+
+// Results that are checked after timing, so the compiler cannot drop the
+// work being measured.
+static volatile uint64_t sink;
+
+static double now() {
+  return chrono::duration<double>(
+    chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// EFFECTS: Runs f repeat times, calling setup untimed before each run,
+//          and returns the fastest time in seconds.
+template <typename S, typename F>
+static double best_of(int repeat, S setup, F f) {
+  double best = 0;
+  for (int i = 0; i < repeat; ++i) {
+    setup();
+    double start = now();
+    f();
+    double elapsed = now() - start;
+    if (i == 0 || elapsed < best) {
+      best = elapsed;
+    }
+  }
+  return best;
+}
+
+// EFFECTS: Runs f repeat times and returns the fastest time in seconds.
+template <typename F>
+static double best_of(int repeat, F f) {
+  return best_of(repeat, []() { }, f);
+}
+
+static void report(const string &suite, const string &name,
+                   const string &impl, size_t n, double seconds,
+                   double rate, const string &unit) {
+  cout << "{\"suite\":\"" << suite << "\",\"name\":\"" << name
+       << "\",\"impl\":\"" << impl << "\",\"n\":" << n
+       << ",\"seconds\":" << seconds << ",\"rate\":" << rate
+       << ",\"unit\":\"" << unit << "\"}" << endl;
+}
+
+static bool selected(const Options &opts, const string &suite) {
+  return suite.find(opts.filter) != string::npos;
+}
+
+// TREES
+
+// EFFECTS: Times inserting keys into an empty M, finding every key in a
+//          different order, and iterating over the result. The tree from
+//          the previous insert run is destroyed outside the timing.
+template <typename M>
+static void bench_tree(const Options &opts, const string &impl,
+                       const vector<int> &keys, const vector<int> &probes) {
+  M m;
+  double insert = best_of(opts.repeat, [&]() { m = M(); }, [&]() {
+    for (size_t i = 0; i < keys.size(); ++i) {
+      m[keys[i]] = static_cast<int>(i);
+    }
+  });
+  report("tree", "insert", impl, keys.size(), insert,
+         keys.size() / insert, "ops/s");
+
+  double find = best_of(opts.repeat, [&]() {
+    uint64_t found = 0;
+    for (int k : probes) {
+      found += m.find(k) != m.end();
+    }
+    sink = found;
+  });
+  report("tree", "find", impl, probes.size(), find,
+         probes.size() / find, "ops/s");
+
+  double iterate = best_of(opts.repeat, [&]() {
+    uint64_t sum = 0;
+    for (const auto &kv : m) {
+      sum += static_cast<uint64_t>(kv.second);
+    }
+    sink = sum;
+  });
+  report("tree", "iterate", impl, m.size(), iterate,
+         m.size() / iterate, "elements/s");
+}
+
+static void bench_trees(const Options &opts) {
+  mt19937 gen(1);
+  vector<int> keys(opts.size);
+  for (int &k : keys) {
+    k = static_cast<int>(gen());
+  }
+  vector<int> probes = keys;
+  shuffle(probes.begin(), probes.end(), gen);
+
+  bench_tree<std::map<int, int>>(opts, "std::map", keys, probes);
+  bench_tree<Map<int, int>>(opts, "Map", keys, probes);
+  bench_tree<Map<int, int, less<int>, AvlTree>>(opts, "Map<AvlTree>",
+                                                keys, probes);
+  bench_tree<Map<int, int, less<int>, RecursiveAvlTree>>(
+    opts, "Map<AvlTree,bst_recursive>", keys, probes);
+  bench_tree<Map<int, int, less<int>, PooledTree>>(opts, "Map<PooledTree>",
+                                                   keys, probes);
+  bench_tree<Map<int, int, less<int>, PooledAvlTree>>(
+    opts, "Map<PooledAvlTree>", keys, probes);
+  bench_tree<Map<int, int, less<int>, BTree>>(opts, "Map<BTree>",
+                                              keys, probes);
+  bench_tree<Map<int, int, less<int>, PersistentTree>>(
+    opts, "Map<PersistentTree>", keys, probes);
+}
+
+// DEEP TREES
+
+// EFFECTS: Exits with an error naming what failed unless ok.
+static void check(bool ok, const string &suite, const string &what) {
+  if (!ok) {
+    cerr << "benchmark: " << suite << ": " << what << " failed" << endl;
+    exit(1);
+  }
+}
+
+// EFFECTS: Builds an unbalanced tree from the keys 0 to opts.depth - 1
+//          inserted in increasing (or decreasing) order, so that it is a
+//          single chain opts.depth nodes long. Then times and checks each
+//          walk the tree offers that can go all the way down: find, nth,
+//          rank, min_greater_than, lower_bound, upper_bound, height, erase,
+//          reverse iteration, copying and destroying.
+template <typename Tree>
+static void bench_deep_chain(const Options &opts, const string &impl,
+                             bool increasing) {
+  const int depth = static_cast<int>(opts.depth);
+  const int deepest = increasing ? depth - 1 : 0;
+  Tree chain;
+  double start = now();
+  for (int i = 0; i < depth; ++i) {
+    chain.insert(increasing ? i : depth - 1 - i);
+  }
+  double insert = now() - start;
+  check(chain.size() == opts.depth, "deep", impl + " insert");
+  report("deep", "insert", impl, opts.depth, insert,
+         opts.depth / insert, "ops/s");
+
+  // Times one walk to the bottom of the chain, which must return true.
+  auto walk = [&](const string &name, auto f) {
+    double seconds = best_of(opts.repeat, [&]() {
+      check(f(), "deep", impl + " " + name);
+    });
+    report("deep", name, impl, 1, seconds, 1 / seconds, "ops/s");
+  };
+  auto at_deepest = [&](typename Tree::Iterator it) {
+    return it != chain.end() && *it == deepest;
+  };
+  walk("find", [&]() { return at_deepest(chain.find(deepest)); });
+  walk("nth", [&]() { return at_deepest(chain.nth(deepest)); });
+  walk("rank", [&]() {
+    return chain.rank(deepest) == static_cast<size_t>(deepest);
+  });
+  walk("min_greater_than", [&]() {
+    return at_deepest(chain.min_greater_than(deepest - 1));
+  });
+  walk("lower_bound", [&]() {
+    return at_deepest(chain.lower_bound(deepest));
+  });
+  walk("upper_bound", [&]() {
+    return at_deepest(chain.upper_bound(deepest - 1));
+  });
+  walk("height", [&]() { return chain.height() == opts.depth; });
+  walk("erase+insert", [&]() {
+    bool erased = chain.erase(deepest) == 1;
+    chain.insert(deepest);
+    return erased && chain.height() == opts.depth;
+  });
+
+  double reverse = best_of(opts.repeat, [&]() {
+    int expected = depth - 1;
+    for (auto it = chain.rbegin(); it != chain.rend(); ++it) {
+      check(*it == expected, "deep", impl + " reverse iteration");
+      --expected;
+    }
+    check(expected == -1, "deep", impl + " reverse iteration");
+  });
+  report("deep", "reverse_iterate", impl, opts.depth, reverse,
+         opts.depth / reverse, "elements/s");
+
+  double copy = 0;
+  double destroy = 0;
+  for (int i = 0; i < opts.repeat; ++i) {
+    double copy_start = now();
+    Tree *copied = new Tree(chain);
+    double copy_end = now();
+    check(copied->size() == opts.depth &&
+          copied->find(deepest) != copied->end(), "deep", impl + " copy");
+    double destroy_start = now();
+    delete copied;
+    double destroy_end = now();
+    if (i == 0 || copy_end - copy_start < copy) {
+      copy = copy_end - copy_start;
+    }
+    if (i == 0 || destroy_end - destroy_start < destroy) {
+      destroy = destroy_end - destroy_start;
+    }
+  }
+  report("deep", "copy", impl, opts.depth, copy, opts.depth / copy,
+         "elements/s");
+  report("deep", "destroy", impl, opts.depth, destroy, opts.depth / destroy,
+         "elements/s");
+}
+
+// EFFECTS: Runs bench_deep_chain on a chain of right children and on a
+//          chain of left children. Run under a small stack, as make
+//          bench-deep does, this checks that every walk above needs
+//          constant stack space under the default kernels; the recursive
+//          kernels overflow a 256 KB stack at a few thousand levels. The
+//          diagnostic walks (the invariant checks, stats, traversals and
+//          to_string) are recursive by design and not covered.
+static void bench_deep(const Options &opts) {
+  bench_deep_chain<BinarySearchTree<int>>(opts, "BinarySearchTree/right chain",
+                                          true);
+  bench_deep_chain<BinarySearchTree<int>>(opts, "BinarySearchTree/left chain",
+                                          false);
+}
+
+// CONCURRENT MAP
+
+// EFFECTS: For 1, 2, 4, ... 64 reader threads, measures how many finds per
+//          second the readers make in total while one writer keeps
+//          updating the map.
+static void bench_concurrent(const Options &opts) {
+  const int keys = static_cast<int>(opts.size);
+  const double duration = 0.2;
+  ConcurrentMap<int, int> m;
+  m.update([&](auto &version) {
+    for (int k = 0; k < keys; ++k) {
+      version[k] = k;
+    }
+  });
+
+  for (int readers = 1; readers <= 64; readers *= 2) {
+    atomic<bool> done(false);
+    atomic<uint64_t> finds(0);
+    atomic<uint64_t> found_total(0);
+    uint64_t writes = 0;
+    vector<thread> threads;
+    for (int r = 0; r < readers; ++r) {
+      threads.emplace_back([&, r]() {
+        ConcurrentMap<int, int>::Reader reader(m);
+        mt19937 gen(r + 1);
+        uint64_t count = 0;
+        uint64_t found = 0;
+        while (!done.load(memory_order_relaxed)) {
+          auto version = reader.pin();
+          for (int i = 0; i < 64; ++i) {
+            found += version->find(static_cast<int>(gen() % keys)) !=
+              version->end();
+          }
+          count += 64;
+        }
+        finds += count;
+        found_total += found;
+      });
+    }
+    double start = now();
+    while (now() - start < duration) {
+      m.insert_or_assign(static_cast<int>(writes % keys),
+                         static_cast<int>(writes));
+      ++writes;
+    }
+    done = true;
+    for (thread &t : threads) {
+      t.join();
+    }
+    sink = found_total;
+    double seconds = now() - start;
+    string impl = "ConcurrentMap/" + to_string(readers) + "r";
+    report("concurrent", "find", impl, finds, seconds,
+           finds / seconds, "ops/s");
+    report("concurrent", "update", impl, writes, seconds,
+           writes / seconds, "ops/s");
+  }
+}
+
+// EFFECTS: For 2, 8 and 32 reader threads, has the readers pin versions
+//          and check each one while one writer keeps updating the map,
+//          then checks that every replaced version is freed once the
+//          readers are gone. With window the smaller of --size and 1024,
+//          update i leaves keys i to i + window - 1,
+//          each mapped to twice itself, and a stamp key -1 mapped to i, so
+//          a version is consistent if its stamp, size and contents all
+//          agree. A reader also checks that the stamps it sees never go
+//          backwards. Exits with an error if any check fails.
+static void bench_stress(const Options &opts) {
+  const int window = static_cast<int>(min<size_t>(opts.size, 1024));
+  const double duration = 0.2;
+  for (int readers = 2; readers <= 32; readers *= 4) {
+    ConcurrentMap<int, int> m;
+    m.update([&](auto &version) {
+      version[-1] = 0;
+      for (int k = 0; k < window; ++k) {
+        version[k] = 2 * k;
+      }
+    });
+
+    atomic<bool> done(false);
+    atomic<uint64_t> checked(0);
+    atomic<int> failures(0);
+    vector<thread> threads;
+    for (int r = 0; r < readers; ++r) {
+      threads.emplace_back([&]() {
+        ConcurrentMap<int, int>::Reader reader(m);
+        uint64_t count = 0;
+        int last_stamp = 0;
+        while (!done.load(memory_order_relaxed)) {
+          auto version = reader.pin();
+          auto stamp = version->find(-1);
+          bool ok = stamp != version->end() &&
+            version->size() == static_cast<size_t>(window) + 1 &&
+            stamp->second >= last_stamp;
+          int expected = ok ? stamp->second : 0;
+          for (auto it = version->begin(); ok && it != version->end();
+               ++it) {
+            if (it->first == -1) {
+              continue;
+            }
+            ok = it->first == expected && it->second == 2 * expected;
+            ++expected;
+          }
+          ok = ok && expected == stamp->second + window &&
+            version->find(-1)->second == stamp->second;
+          if (!ok) {
+            ++failures;
+            break;
+          }
+          last_stamp = stamp->second;
+          ++count;
+        }
+        checked += count;
+      });
+    }
+
+    int writes = 0;
+    double start = now();
+    while (now() - start < duration) {
+      ++writes;
+      m.update([&](auto &version) {
+        version.erase(writes - 1);
+        version[writes - 1 + window] = 2 * (writes - 1 + window);
+        version[-1] = writes;
+      });
+    }
+    done = true;
+    for (thread &t : threads) {
+      t.join();
+    }
+    double seconds = now() - start;
+    string impl = "ConcurrentMap/" + to_string(readers) + "r";
+    check(failures == 0, "stress", impl + " version consistency");
+    m.reclaim();
+    check(m.pending_versions() == 0, "stress", impl + " reclamation");
+    report("stress", "check", impl, checked, seconds, checked / seconds,
+           "versions/s");
+    report("stress", "update", impl, writes, seconds, writes / seconds,
+           "ops/s");
+  }
+}
+
+// GENERATED POSTS
+
+struct Post {
+  string tag;
+  string content;
+};
+
+// EFFECTS: Returns n posts of 5 to 40 words drawn from a fixed vocabulary
+//          with a skewed distribution, some capitalized or punctuated.
+//          Each post is tagged by which half of the vocabulary most of
+//          its words came from, so the classifier has something to learn.
+static vector<Post> make_posts(size_t n) {
+  mt19937 gen(2);
+  vector<string> vocabulary(5000);
+  for (string &word : vocabulary) {
+    size_t length = 2 + gen() % 9;
+    for (size_t i = 0; i < length; ++i) {
+      word += static_cast<char>('a' + gen() % 26);
+    }
+  }
+  const char *tags[] = { "positive", "negative", "neutral" };
+  vector<Post> posts(n);
+  for (Post &post : posts) {
+    size_t words = 5 + gen() % 36;
+    int votes[3] = { 0, 0, 0 };
+    for (size_t i = 0; i < words; ++i) {
+      // Squaring a uniform draw favors the first words of the vocabulary.
+      double u = static_cast<double>(gen()) / mt19937::max();
+      size_t index = static_cast<size_t>(u * u * (vocabulary.size() - 1));
+      ++votes[index % 3];
+      string word = vocabulary[index];
+      if (gen() % 10 == 0) {
+        word[0] = static_cast<char>(word[0] - 'a' + 'A');
+      }
+      if (gen() % 8 == 0) {
+        word += gen() % 2 ? "," : "!";
+      }
+      post.content += (i ? " " : "") + word;
+    }
+    post.tag = tags[max_element(votes, votes + 3) - votes];
+  }
+  return posts;
+}
+
+// EFFECTS: Returns posts as CSV text with the columns the classifier
+//          reads, quoting content that contains a comma.
+static string to_csv(const vector<Post> &posts) {
+  string csv = "n,tag,content\n";
+  for (size_t i = 0; i < posts.size(); ++i) {
+    const string &content = posts[i].content;
+    bool quote = content.find(',') != string::npos;
+    csv += to_string(i + 1) + "," + posts[i].tag + "," +
+      (quote ? "\"" + content + "\"" : content) + "\n";
+  }
+  return csv;
+}
+
+static void write_file(const string &path, const string &text) {
+  ofstream out(path, ios::binary);
+  out << text;
+}
+
+// CSV
+
+static void bench_csv(const Options &opts, const string &dir,
+                      const vector<Post> &posts) {
+  string csv = to_csv(posts);
+  double mb = csv.size() / 1e6;
+
+  double map_rows = best_of(opts.repeat, [&]() {
+    istringstream is(csv);
+    csvstream in(is);
+    std::map<string, string> row;
+    uint64_t bytes = 0;
+    while (in >> row) {
+      bytes += row["content"].size();
+    }
+    sink = bytes;
+  });
+  report("csv", "parse", "istream/map", posts.size(), map_rows,
+         mb / map_rows, "MB/s");
+
+  string path = dir + "/posts.csv";
+  write_file(path, csv);
+  double mapped = best_of(opts.repeat, [&]() {
+    csvstream in(path, ',', true, true);
+    in.select({ "tag", "content" });
+    vector<string_view> row;
+    uint64_t bytes = 0;
+    while (in >> row) {
+      bytes += row[1].size();
+    }
+    sink = bytes;
+  });
+  report("csv", "parse", "mmap/string_view", posts.size(), mapped,
+         mb / mapped, "MB/s");
+  remove(path.c_str());
+}
+
+// TOKENIZER
+
+static void bench_tokenize(const Options &opts, const vector<Post> &posts) {
+  Tokenizer tokenizer;
+  double seconds = best_of(opts.repeat, [&]() {
+    uint64_t words = 0;
+    for (const Post &post : posts) {
+      words += tokenizer.unique_words(post.content).size();
+    }
+    sink = words;
+  });
+  report("tokenize", "unique_words", "Tokenizer", posts.size(), seconds,
+         posts.size() / seconds, "posts/s");
+}
+
+// END TO END
+
+// EFFECTS: Runs command with its output discarded and returns how long it
+//          took, or a negative time if it failed.
+static double run(const string &command) {
+  double start = now();
+  int status = system((command + " > /dev/null 2>&1").c_str());
+  double elapsed = now() - start;
+  return status == 0 ? elapsed : -1;
+}
+
+static void bench_e2e(const Options &opts, const string &dir,
+                      const vector<Post> &posts) {
+  if (opts.classifier.empty()) {
+    cerr << "benchmark: skipping e2e, no --classifier given" << endl;
+    return;
+  }
+  // Train on the first 80% of the posts and predict the rest.
+  size_t split = posts.size() * 4 / 5;
+  string train = dir + "/train.csv";
+  string test = dir + "/test.csv";
+  string model = dir + "/model.bin";
+  write_file(train, to_csv(vector<Post>(posts.begin(),
+                                        posts.begin() + split)));
+  write_file(test, to_csv(vector<Post>(posts.begin() + split, posts.end())));
+  string classifier = "'" + opts.classifier + "'";
+
+  struct Step {
+    const char *name;
+    const char *impl;
+    string command;
+    size_t posts;
+  };
+  unsigned threads = max(2u, thread::hardware_concurrency());
+  Step steps[] = {
+    { "train", "1 thread",
+      classifier + " " + train + " --save-model " + model, split },
+    { "train", "threads",
+      classifier + " " + train + " --save-model " + model +
+        " --threads " + to_string(threads), split },
+    { "predict", "1 thread",
+      classifier + " --load-model " + model + " " + test,
+      posts.size() - split },
+    { "train+predict", "1 thread", classifier + " " + train + " " + test,
+      posts.size() },
+  };
+  for (const Step &step : steps) {
+    bool ok = true;
+    double seconds = best_of(opts.repeat, [&]() {
+      ok = run(step.command) >= 0 && ok;
+    });
+    if (!ok) {
+      cerr << "benchmark: failed: " << step.command << endl;
+      continue;
+    }
+    string impl = step.impl;
+    if (impl == "threads") {
+      impl = to_string(threads) + " threads";
+    }
+    report("e2e", step.name, impl, step.posts, seconds,
+           step.posts / seconds, "posts/s");
+  }
+  remove(train.c_str());
+  remove(test.c_str());
+  remove(model.c_str());
+}
+
+int main(int argc, char *argv[]) {
+  Options opts;
+  for (int i = 1; i < argc; ++i) {
+    bool has_value = i + 1 < argc;
+    if (!strcmp(argv[i], "--size") && has_value) {
+      opts.size = strtoul(argv[++i], nullptr, 10);
+    }
+    else if (!strcmp(argv[i], "--posts") && has_value) {
+      opts.posts = strtoul(argv[++i], nullptr, 10);
+    }
+    else if (!strcmp(argv[i], "--depth") && has_value) {
+      opts.depth = strtoul(argv[++i], nullptr, 10);
+    }
+    else if (!strcmp(argv[i], "--repeat") && has_value) {
+      opts.repeat = atoi(argv[++i]);
+    }
+    else if (!strcmp(argv[i], "--filter") && has_value) {
+      opts.filter = argv[++i];
+    }
+    else if (!strcmp(argv[i], "--classifier") && has_value) {
+      opts.classifier = argv[++i];
+    }
+    else {
+      cout << "Usage: benchmark [--size N] [--posts N] [--depth N]"
+           << " [--repeat N] [--filter SUITE] [--classifier PATH]" << endl;
+      return 1;
+    }
+  }
+  if (opts.size == 0 || opts.posts < 5 || opts.depth == 0 ||
+      opts.depth > static_cast<size_t>(numeric_limits<int>::max()) ||
+      opts.repeat < 1) {
+    cout << "benchmark: --size, --posts, --depth and --repeat must be at"
+         << " least 1, 5, 1 and 1" << endl;
+    return 1;
+  }
+
+  char dir_template[] = "/tmp/bench.XXXXXX";
+  if (!mkdtemp(dir_template)) {
+    cout << "benchmark: cannot create a temporary directory" << endl;
+    return 1;
+  }
+  string dir = dir_template;
+
+  cout << "{\"suite\":\"meta\",\"size\":" << opts.size
+       << ",\"posts\":" << opts.posts << ",\"depth\":" << opts.depth
+       << ",\"repeat\":" << opts.repeat
+       << ",\"hardware_threads\":" << thread::hardware_concurrency()
+       << "}" << endl;
+
+  if (selected(opts, "tree")) {
+    bench_trees(opts);
+  }
+  if (selected(opts, "deep")) {
+    bench_deep(opts);
+  }
+  if (selected(opts, "concurrent")) {
+    bench_concurrent(opts);
+  }
+  if (selected(opts, "stress")) {
+    bench_stress(opts);
+  }
+  vector<Post> posts;
+  if (selected(opts, "csv") || selected(opts, "tokenize") ||
+      selected(opts, "e2e")) {
+    posts = make_posts(opts.posts);
+  }
+  if (selected(opts, "csv")) {
+    bench_csv(opts, dir, posts);
+  }
+  if (selected(opts, "tokenize")) {
+    bench_tokenize(opts, posts);
+  }
+  if (selected(opts, "e2e")) {
+    bench_e2e(opts, dir, posts);
+  }
+  rmdir(dir.c_str());
+  return 0;
+}
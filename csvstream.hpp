@@ -14,10 +14,15 @@
 #include <sstream>
 #include <cassert>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <map>
 #include <regex>
 #include <exception>
+#include <algorithm>
+#include <memory>
+#include <stdexcept>
+#include "MappedFile.hpp"
 
 
 // A custom exception type
@@ -35,7 +40,11 @@ public:
 class csvstream {
 public:
   // Constructor from filename. Throws csvstream_exception if open fails.
-  csvstream(const std::string &filename, char delimiter=',', bool strict=true);
+  // When memory_map is true, the file is memory-mapped (or, where mapping
+  // is unavailable, read into memory whole) and scanned in place instead of
+  // being read through an ifstream.
+  csvstream(const std::string &filename, char delimiter=',', bool strict=true,
+            bool memory_map=false);
 
   // Constructor from stream
   csvstream(std::istream &is, char delimiter=',', bool strict=true);
@@ -58,6 +67,29 @@ public:
   // header.
   csvstream & operator>> (std::vector<std::pair<std::string, std::string> >& row);
 
+  // Stream extraction operator reads one row, keeping column order (or just
+  // the columns chosen by select()), as views that stay valid until the next
+  // read. With a memory-mapped file, fields
+  // that contain no quotes point straight into the mapping and are never
+  // copied. Throws csvstream_exception if the number of items in a row does
+  // not match the header.
+  csvstream & operator>> (std::vector<std::string_view>& row);
+
+  // Restrict the rows read by the vector<string_view> and vector<string>
+  // extraction operators to the named columns, in the given order. Names
+  // are resolved against the header once, here. Fields in other columns are
+  // still counted but are skipped without being copied, so the map and pair
+  // extraction operators see them as empty. Throws csvstream_exception if a
+  // column is not in the header.
+  void select(const std::vector<std::string> &columns);
+
+  // Stream extraction operator reads one row of the selected columns into a
+  // record that is reused between rows: its strings are overwritten in
+  // place, so once they have grown no allocation is needed. Throws
+  // csvstream_exception if the number of items in a row does not match the
+  // header.
+  csvstream & operator>> (std::vector<std::string>& record);
+
 private:
   // Filename.  Used for error messages.
   std::string filename;
@@ -82,9 +114,47 @@ private:
   // Store header column names
   std::vector<std::string> header;
 
+  // Memory-mapped input, or null when reading from is
+  std::unique_ptr<MappedFile> mapping;
+  const char *map_begin;
+  const char *map_end;
+  const char *map_pos;
+
+  // False once a read from the mapping has failed, like a stream's failbit
+  bool map_ok;
+
+  // Characters that end the fast scan of an unquoted field in mapped mode,
+  // built once when the file is mapped
+  bool map_special[256];
+
+  // Storage for the most recent row read as views. In stream mode every
+  // field lives in line_data; in mapped mode only fields that had quotes
+  // removed do, at the index given by line_copy (-1 for a direct view).
+  std::vector<std::string> line_data;
+  std::vector<std::string_view> line_views;
+  std::vector<int> line_copy;
+
+  // Header indices of the columns chosen by select(), and a per-column flag
+  // for whether a field must be kept (empty means keep every column)
+  std::vector<size_t> selected;
+  std::vector<char> keep_columns;
+  std::vector<std::string_view> selected_views;
+
   // Process header, the first line of the file
   void read_header();
 
+  // Read one line into line_views. Returns false at end of input.
+  bool read_line();
+
+  // Read and tokenize one line from the mapping into line_views
+  bool read_mapped_line();
+
+  // Check the number of fields in line_views against the header
+  void check_row_size();
+
+  // Read the next row of the selected columns into line_views.
+  bool read_selected();
+
   // Disable copying because copying streams is bad!
   csvstream(const csvstream &);
   csvstream & operator= (const csvstream &);
@@ -95,14 +165,23 @@ private:
 // Implementation
 
 // Read and tokenize one line from a stream
+// Characters of columns whose keep_columns flag is false are not stored; an
+// empty keep_columns keeps every column.
 static bool read_csv_line(std::istream &is,
                           std::vector<std::string> &data,
-                          char delimiter
+                          char delimiter,
+                          const std::vector<char> &keep_columns = {}
                           ) {
 
   // Add entry for first token, start with empty string
   data.clear();
   data.push_back(std::string());
+  auto kept = [&]() {
+    size_t column = data.size() - 1;
+    return keep_columns.empty() ||
+      (column < keep_columns.size() && keep_columns[column]);
+  };
+  bool keep = kept();
 
   // Process one character at a time
   char c = '\0';
@@ -127,10 +206,11 @@ static bool read_csv_line(std::istream &is,
         state = QUOTED;
       } else if (c == '\\') { //note this checks for a single backslash char
         state = UNQUOTED_ESCAPED;
-        data.back() += c;
+        if (keep) data.back() += c;
       } else if (c == delimiter) {
         // If you see a delimiter, then start a new field with an empty string
         data.push_back("");
+        keep = kept();
       } else if (c == '\n' || c == '\r') {
         // If you see a line ending *and it's not within a quoted token*, stop
         // parsing the line.  Works for UNIX (\n) and OSX (\r) line endings.
@@ -138,13 +218,13 @@ static bool read_csv_line(std::istream &is,
         state = END;
       } else {
         // Append character to current token
-        data.back() += c;
+        if (keep) data.back() += c;
       }
       break;
 
     case UNQUOTED_ESCAPED:
       // If a character is escaped, add it no matter what.
-      data.back() += c;
+      if (keep) data.back() += c;
       state = UNQUOTED;
       break;
 
@@ -154,16 +234,16 @@ static bool read_csv_line(std::istream &is,
         state = UNQUOTED;
       } else if (c == '\\') {
         state = QUOTED_ESCAPED;
-        data.back() += c;
+        if (keep) data.back() += c;
       } else {
         // Append character to current token
-        data.back() += c;
+        if (keep) data.back() += c;
       }
       break;
 
     case QUOTED_ESCAPED:
       // If a character is escaped, add it no matter what.
-      data.back() += c;
+      if (keep) data.back() += c;
       state = QUOTED;
       break;
 
@@ -199,17 +279,133 @@ static bool read_csv_line(std::istream &is,
 }
 
 
-csvstream::csvstream(const std::string &filename, char delimiter, bool strict)
+// Read and tokenize one line from the mapping. Follows the same rules as
+// read_csv_line(): quotes are dropped, a backslash is kept along with the
+// character after it, and \n, \r or \r\n ends a line outside quotes. A field
+// with no quotes is exactly the bytes between delimiters, so it is returned
+// as a view into the mapping; only fields that had quotes removed are built
+// up in line_data. Fields in columns that are not kept are returned empty.
+bool csvstream::read_mapped_line() {
+  line_views.clear();
+  line_copy.clear();
+  if (map_pos == map_end) {
+    map_ok = false;
+    return false;
+  }
+
+  const char *p = map_pos;
+  const char *field_begin = p;
+  int copy = -1;  // index into line_data while the field is being copied
+  bool quoted = false;
+  size_t num_copies = 0;
+
+  auto kept = [&]() {
+    size_t column = line_views.size();
+    return keep_columns.empty() ||
+      (column < keep_columns.size() && keep_columns[column]);
+  };
+  bool keep = kept();
+
+  auto start_copy = [&](const char *upto) {
+    if (num_copies == line_data.size()) line_data.emplace_back();
+    copy = static_cast<int>(num_copies++);
+    line_data[copy].assign(field_begin, upto);
+  };
+  auto end_field = [&](const char *field_end) {
+    if (!keep) {
+      // Skipped columns read as empty, as they do in stream mode
+      line_views.emplace_back();
+    } else if (copy == -1) {
+      line_views.emplace_back(field_begin, field_end - field_begin);
+    } else {
+      line_views.emplace_back();
+    }
+    line_copy.push_back(copy);
+    copy = -1;
+  };
+
+  while (true) {
+    if (!quoted && copy == -1) {
+      while (p != map_end && !map_special[static_cast<unsigned char>(*p)]) {
+        ++p;
+      }
+    } else if (quoted && !keep) {
+      // Nothing in a skipped quoted field matters but its closing quote.
+      while (p != map_end && *p != '"' && *p != '\\') ++p;
+    }
+    if (p == map_end) {
+      end_field(p);
+      break;
+    }
+    char c = *p++;
+    if (c == '\\') {
+      // A backslash and the character after it are kept no matter what
+      if (copy != -1) {
+        line_data[copy] += c;
+        if (p != map_end) line_data[copy] += *p;
+      }
+      if (p != map_end) ++p;
+    } else if (c == '"') {
+      if (copy == -1 && keep) start_copy(p - 1);
+      quoted = !quoted;
+    } else if (quoted) {
+      if (copy != -1) line_data[copy] += c;
+    } else if (c == delimiter) {
+      end_field(p - 1);
+      field_begin = p;
+      keep = kept();
+    } else if (c == '\n' || c == '\r') {
+      end_field(p - 1);
+      // Consume the second character of a Windows line ending (\r\n).
+      if (p != map_end && *p == '\n') ++p;
+      break;
+    } else if (copy != -1) {
+      line_data[copy] += c;
+    }
+  }
+  map_pos = p;
+
+  // line_data is done growing, so views into it are now stable
+  for (size_t i = 0; i < line_views.size(); ++i) {
+    if (line_copy[i] != -1) line_views[i] = line_data[line_copy[i]];
+  }
+  return true;
+}
+
+
+csvstream::csvstream(const std::string &filename, char delimiter, bool strict,
+                     bool memory_map)
   : filename(filename),
     is(fin),
     delimiter(delimiter),
     strict(strict),
-    line_no(0) {
-
-  // Open file
-  fin.open(filename.c_str());
-  if (!fin.is_open()) {
-    throw csvstream_exception("Error opening file: " + filename);
+    line_no(0),
+    map_begin(nullptr),
+    map_end(nullptr),
+    map_pos(nullptr),
+    map_ok(false) {
+
+  if (memory_map) {
+    try {
+      mapping.reset(new MappedFile(filename, true));
+    }
+    catch (const std::runtime_error &e) {
+      throw csvstream_exception(e.what());
+    }
+    map_begin = mapping->begin();
+    map_end = mapping->end();
+    map_pos = map_begin;
+    map_ok = true;
+    std::fill(map_special, map_special + 256, false);
+    for (char c : { delimiter, '"', '\\', '\n', '\r' }) {
+      map_special[static_cast<unsigned char>(c)] = true;
+    }
+  } else {
+    // Open file
+    fin.open(filename.c_str());
+    if (!fin.is_open()) {
+      throw csvstream_exception("Error opening file: " + filename);
+    }
   }
 
   // Process header
@@ -222,7 +418,11 @@ csvstream::csvstream(std::istream &is, char delimiter, bool strict)
     is(is),
     delimiter(delimiter),
     strict(strict),
-    line_no(0) {
+    line_no(0),
+    map_begin(nullptr),
+    map_end(nullptr),
+    map_pos(nullptr),
+    map_ok(false) {
   read_header();
 }
 
@@ -233,44 +433,57 @@ csvstream::~csvstream() {
 
 
 csvstream::operator bool() const {
+  if (map_begin) return map_ok;
   return static_cast<bool>(is);
 }
 
 
-std::vector<std::string> csvstream::getheader() const {
-  return header;
-}
-
+bool csvstream::read_line() {
+  if (map_begin) return read_mapped_line();
 
-csvstream & csvstream::operator>> (std::map<std::string, std::string>& row) {
-  // Clear input row
-  row.clear();
+  if (!read_csv_line(is, line_data, delimiter, keep_columns)) return false;
+  line_views.assign(line_data.begin(), line_data.end());
+  return true;
+}
 
-  // Read one line from stream, bail out if we're at the end
-  std::vector<std::string> data;
-  if (!read_csv_line(is, data, delimiter)) return *this;
-  line_no += 1;
 
+void csvstream::check_row_size() {
   // When strict mode is disabled, coerce the length of the data.  If data is
   // larger than header, discard extra values.  If data is smaller than header,
   // pad data with empty strings.
   if (!strict) {
-    data.resize(header.size());
+    line_views.resize(header.size());
   }
 
   // Check length of data
-  if (data.size() != header.size()) {
+  if (line_views.size() != header.size()) {
     auto msg = "Number of items in row does not match header. " +
       filename + ":L" + std::to_string(line_no) + " " +
       "header.size() = " + std::to_string(header.size()) + " " +
-      "row.size() = " + std::to_string(data.size()) + " "
+      "row.size() = " + std::to_string(line_views.size()) + " "
       ;
     throw csvstream_exception(msg);
   }
+}
+
+
+std::vector<std::string> csvstream::getheader() const {
+  return header;
+}
+
+
+csvstream & csvstream::operator>> (std::map<std::string, std::string>& row) {
+  // Clear input row
+  row.clear();
+
+  // Read one line from stream, bail out if we're at the end
+  if (!read_line()) return *this;
+  line_no += 1;
+  check_row_size();
 
   // combine data and header into a row object
-  for (size_t i=0; i<data.size(); ++i) {
-    row[header[i]] = data[i];
+  for (size_t i=0; i<line_views.size(); ++i) {
+    row[header[i]] = std::string(line_views[i]);
   }
 
   return *this;
@@ -283,41 +496,81 @@ csvstream & csvstream::operator>> (std::vector<std::pair<std::string, std::strin
   row.resize(header.size());
 
   // Read one line from stream, bail out if we're at the end
-  std::vector<std::string> data;
-  if (!read_csv_line(is, data, delimiter)) return *this;
+  if (!read_line()) return *this;
   line_no += 1;
+  check_row_size();
 
-  // When strict mode is disabled, coerce the length of the data.  If data is
-  // larger than header, discard extra values.  If data is smaller than header,
-  // pad data with empty strings.
-  if (!strict) {
-    data.resize(header.size());
+  // combine data and header into a row object
+  for (size_t i=0; i<line_views.size(); ++i) {
+    row[i] = make_pair(header[i], std::string(line_views[i]));
   }
 
-  // Check length of data
-  if (row.size() != header.size()) {
-    auto msg = "Number of items in row does not match header. " +
-      filename + ":L" + std::to_string(line_no) + " " +
-      "header.size() = " + std::to_string(header.size()) + " " +
-      "row.size() = " + std::to_string(row.size()) + " "
-      ;
-    throw csvstream_exception(msg);
+  return *this;
+}
+
+
+csvstream & csvstream::operator>> (std::vector<std::string_view>& row) {
+  // Clear input row
+  row.clear();
+
+  // Read one line from stream, bail out if we're at the end
+  if (!read_selected()) return *this;
+
+  row = line_views;
+  return *this;
+}
+
+
+void csvstream::select(const std::vector<std::string> &columns) {
+  selected.clear();
+  keep_columns.assign(header.size(), false);
+  for (const std::string &column : columns) {
+    size_t i = 0;
+    while (i < header.size() && header[i] != column) ++i;
+    if (i == header.size()) {
+      throw csvstream_exception("Column not found in header: " + column +
+                                " " + filename);
+    }
+    selected.push_back(i);
+    keep_columns[i] = true;
   }
+}
 
-  // combine data and header into a row object
-  for (size_t i=0; i<data.size(); ++i) {
-    row[i] = make_pair(header[i], data[i]);
+
+bool csvstream::read_selected() {
+  if (!read_line()) return false;
+  line_no += 1;
+  check_row_size();
+  if (!selected.empty()) {
+    selected_views.resize(selected.size());
+    for (size_t i = 0; i < selected.size(); ++i) {
+      selected_views[i] = line_views[selected[i]];
+    }
+    line_views.swap(selected_views);
   }
+  return true;
+}
+
 
+csvstream & csvstream::operator>> (std::vector<std::string>& record) {
+  if (!read_selected()) {
+    record.clear();
+    return *this;
+  }
+  record.resize(line_views.size());
+  for (size_t i = 0; i < line_views.size(); ++i) {
+    record[i].assign(line_views[i].data(), line_views[i].size());
+  }
   return *this;
 }
 
 
 void csvstream::read_header() {
   // read first line, which is the header
-  if (!read_csv_line(is, header, delimiter)) {
+  if (!read_line()) {
     throw csvstream_exception("error reading header");
   }
+  header.assign(line_views.begin(), line_views.end());
 }
 
 #endif
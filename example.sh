@@ -28,6 +28,7 @@ echo
 echo "3. Using Makefile targets:"
 echo "   make test    - Build and run with sample data"
 echo "   make debug   - Build and run with debug output"
+echo "   make bench   - Build and run the benchmarks"
 echo "   make clean   - Remove build artifacts"
 echo
 
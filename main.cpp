@@ -9,193 +9,834 @@
 #include <regex>
 #include <algorithm>
 #include <cctype>
+#include <cstring>
+#include <functional>
+#include <string_view>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <tuple>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <stdexcept>
 #include "csvstream.hpp"
+#include "MappedFile.hpp"
+#include "Tokenizer.hpp"
 
 using namespace std;
 
-set<string> unique_words(const string &str) {
-  istringstream source(str);
-  set<string> words;
-  string word;
-  while (source >> word) {
-    // Convert to lowercase for case-insensitive matching
-    transform(word.begin(), word.end(), word.begin(), ::tolower);
-    // Remove punctuation
-    word.erase(remove_if(word.begin(), word.end(), ::ispunct), word.end());
-    if (!word.empty()) {
-      words.insert(word);
+// Binary model files are a sequence of arrays, each written as a uint64
+// element count followed by the raw elements and padded to a multiple of 8
+// bytes, so every array starts aligned within the file and can be read back
+// with a single bulk copy.
+template <typename T>
+void write_array(ostream& out, const T* data, uint64_t count) {
+  static const char padding[8] = {};
+  out.write(reinterpret_cast<const char*>(&count), sizeof(count));
+  out.write(reinterpret_cast<const char*>(data), count * sizeof(T));
+  out.write(padding, (8 - count * sizeof(T) % 8) % 8);
+}
+
+// A read-only array that either owns its elements or views elements stored
+// elsewhere, such as in a mapped model file. Readers go through data() and
+// operator[] and need not care which; owned() returns the elements as a
+// vector to modify, first copying in any that were only viewed.
+template <typename T>
+class Table {
+  public:
+    const T* data() const {
+      return view ? view : items.data();
+    }
+
+    size_t size() const {
+      return view ? view_size : items.size();
+    }
+
+    const T& operator[](size_t i) const {
+      return data()[i];
+    }
+
+    const T* begin() const {
+      return data();
+    }
+
+    const T* end() const {
+      return data() + size();
+    }
+
+    vector<T>& owned() {
+      if (view) {
+        items.assign(view, view + view_size);
+        view = nullptr;
+        view_size = 0;
+      }
+      return items;
+    }
+
+    // Views the count elements at p, which must stay valid until this
+    // Table is destroyed or owned() is called.
+    void set_view(const T* p, size_t count) {
+      vector<T>().swap(items);
+      view = p;
+      view_size = count;
     }
+
+  private:
+    vector<T> items;
+    const T* view = nullptr;
+    size_t view_size = 0;
+};
+
+// Points table at an array written by write_array() in the bytes at
+// [p, end), without copying it, and advances p past it. Throws
+// runtime_error if the array is truncated or misaligned.
+template <typename T>
+void view_array(const char*& p, const char* end, Table<T>& table) {
+  uint64_t count;
+  if (end - p < static_cast<ptrdiff_t>(sizeof(count))) {
+    throw runtime_error("model file is truncated");
+  }
+  memcpy(&count, p, sizeof(count));
+  p += sizeof(count);
+  if (count > static_cast<uint64_t>(end - p) / sizeof(T)) {
+    throw runtime_error("model file is truncated");
+  }
+  uint64_t bytes = count * sizeof(T);
+  uint64_t padded = bytes + (8 - bytes % 8) % 8;
+  if (padded > static_cast<uint64_t>(end - p)) {
+    throw runtime_error("model file is truncated");
+  }
+  if (reinterpret_cast<uintptr_t>(p) % alignof(T) != 0) {
+    throw runtime_error("model file is misaligned");
+  }
+  table.set_view(reinterpret_cast<const T*>(p), count);
+  p += padded;
+}
+
+// 64-bit FNV-1a. Unlike std::hash it is the same in every build, so hash
+// tables built from it can be saved and used in place.
+inline uint64_t portable_hash(string_view str) {
+  uint64_t h = 14695981039346656037ull;
+  for (char c : str) {
+    h = (h ^ static_cast<unsigned char>(c)) * 1099511628211ull;
   }
-  return words;
+  return h;
 }
 
+// Interns strings to dense integer ids.  Ids are handed out in insertion
+// order starting at 0, so they can index flat per-word and per-label arrays
+// instead of keying a tree by string.  The strings themselves are packed
+// end to end in one buffer.
+class Vocabulary {
+  public:
+    // Returns the id for str, or -1 if str has not been interned.
+    int lookup(string_view str) const {
+      if (slots.size() == 0) {
+        return -1;
+      }
+      const int* slot = slots.data();
+      const uint64_t* hash = hashes.data();
+      const size_t mask = slots.size() - 1;
+      uint64_t h = portable_hash(str);
+      for (size_t i = h & mask; slot[i] != -1; i = (i + 1) & mask) {
+        int id = slot[i];
+        if (hash[id] == h && name(id) == str) {
+          return id;
+        }
+      }
+      return -1;
+    }
+
+    // Returns the id for str, adding it if it is not present yet.
+    int intern(string_view str) {
+      int id = lookup(str);
+      if (id != -1) {
+        return id;
+      }
+      // Keep the load factor at or below one half.
+      if (2 * (hashes.size() + 1) > slots.size()) {
+        rehash(slots.size() == 0 ? 16 : 2 * slots.size());
+      }
+      id = size();
+      vector<char>& text = chars.owned();
+      text.insert(text.end(), str.begin(), str.end());
+      offsets.owned().push_back(text.size());
+      hashes.owned().push_back(portable_hash(str));
+      place(id);
+      return id;
+    }
+
+    // The view is invalidated by the next call to intern().
+    string_view name(int id) const {
+      return string_view(chars.data() + offsets[id],
+                         offsets[id + 1] - offsets[id]);
+    }
+
+    int size() const {
+      return static_cast<int>(hashes.size());
+    }
+
+    // Returns every id ordered by its string, for output that must be sorted.
+    vector<int> sorted_ids() const {
+      vector<int> ids(size());
+      for (size_t i = 0; i < ids.size(); ++i) {
+        ids[i] = static_cast<int>(i);
+      }
+      sort(ids.begin(), ids.end(), [this](int a, int b) {
+        return name(a) < name(b);
+      });
+      return ids;
+    }
+
+    // Writes the strings in id order and the hash table over them, in the
+    // format read by view().
+    void save(ostream& out) const {
+      write_array(out, chars.data(), chars.size());
+      write_array(out, offsets.data(), offsets.size());
+      write_array(out, hashes.data(), hashes.size());
+      write_array(out, slots.data(), slots.size());
+    }
+
+    // Uses the vocabulary written by save() in place, from [p, end), and
+    // advances p past it. The bytes must stay valid for as long as this
+    // Vocabulary views them. Checks every offset and slot, so that lookups
+    // stay in bounds, but does not rehash. Throws runtime_error on
+    // malformed input.
+    void view(const char*& p, const char* end) {
+      view_array(p, end, chars);
+      view_array(p, end, offsets);
+      view_array(p, end, hashes);
+      view_array(p, end, slots);
+      bool ok = offsets.size() == hashes.size() + 1 &&
+                offsets[0] == 0 && offsets[hashes.size()] == chars.size() &&
+                is_sorted(offsets.begin(), offsets.end()) &&
+                (slots.size() & (slots.size() - 1)) == 0;
+      // Every probe sequence must reach an empty slot.
+      size_t empty = 0;
+      for (size_t i = 0; ok && i < slots.size(); ++i) {
+        ok = slots[i] >= -1 && slots[i] < size();
+        empty += slots[i] == -1;
+      }
+      if (!ok || (slots.size() > 0 && empty == 0) ||
+          (slots.size() == 0 && size() > 0)) {
+        throw runtime_error("model file has a corrupt string table");
+      }
+    }
+
+  private:
+    // String i is chars[offsets[i], offsets[i + 1]).
+    Table<char> chars;
+    Table<uint64_t> offsets = initial_offsets();
+    Table<uint64_t> hashes;
+    // Open-addressing table of ids, -1 marks an empty slot.  The size is
+    // always a power of two.
+    Table<int> slots;
+
+    static Table<uint64_t> initial_offsets() {
+      Table<uint64_t> offsets;
+      offsets.owned().push_back(0);
+      return offsets;
+    }
+
+    void place(int id) {
+      vector<int>& slot = slots.owned();
+      size_t i = hashes[id] & (slot.size() - 1);
+      while (slot[i] != -1) {
+        i = (i + 1) & (slot.size() - 1);
+      }
+      slot[i] = id;
+    }
+
+    void rehash(size_t capacity) {
+      slots.owned().assign(capacity, -1);
+      for (int id = 0; id < size(); ++id) {
+        place(id);
+      }
+    }
+};
+
+// The outcome of classifying one post: the winning label id, or -1 if no
+// label scored above the floor, and its log-probability score.
+struct Prediction {
+  int label;
+  double score;
+};
+
+// Per-thread buffers used while predicting, reused between posts so that
+// scoring allocates nothing once they have grown.
+struct PredictScratch {
+  Tokenizer tokenizer;
+  vector<int> post_words;
+  vector<double> label_scores;
+};
+
 class Classifier {
   private:
     int numPosts = 0;
-    set<string> unique_word_set;
-    set<string> uniqueLabelsInString;
-    map<string, int> word_occur;
-    map<string, int> label_occur;
-    map<string, map<string, int>> label_word_counts;
-    map<int, map<string, string>> string_storage;
+    Tokenizer tokenizer;
+    Vocabulary words;
+    Vocabulary labels;
+    // Number of posts containing each word, indexed by word id.
+    Table<int> word_occur;
+    // Number of posts with each label, indexed by label id.
+    Table<int> label_occur;
+    // Number of posts with a given label containing a given word, stored
+    // word-major: label_word_counts[word * label_stride + label]. The stride
+    // is the label capacity, doubled when a new label does not fit, so
+    // interning labels one by one re-lays the matrix only log(L) times.
+    Table<int> label_word_counts;
+    size_t label_stride = 0;
+    // Scoring tables built from the counts by finalize(), and whether they
+    // are current. log_likelihood is laid out like label_word_counts; for a
+    // (label, word) pair with no count it holds the word's fallback value,
+    // so scoring never branches.
+    bool finalized = false;
+    Table<double> log_prior;
+    Table<double> log_likelihood;
+    double log_unseen = 0;
+    // Label ids in name order, also built by finalize().
+    Table<int> label_order;
+    PredictScratch scratch;
+    // The model file whose arrays the tables above view, after load().
+    unique_ptr<MappedFile> model_file;
+
+    int intern_word(string_view word) {
+      int id = words.intern(word);
+      if (id == static_cast<int>(word_occur.size())) {
+        word_occur.owned().push_back(0);
+        vector<int>& counts = label_word_counts.owned();
+        counts.resize(counts.size() + label_stride, 0);
+      }
+      return id;
+    }
+
+    int intern_label(string_view label) {
+      int id = labels.intern(label);
+      if (id == static_cast<int>(label_occur.size())) {
+        label_occur.owned().push_back(0);
+        if (label_occur.size() > label_stride) {
+          set_label_stride(label_stride ? 2 * label_stride : 4);
+        }
+      }
+      return id;
+    }
+
+    // Re-lays label_word_counts with room for stride labels per word.
+    void set_label_stride(size_t stride) {
+      size_t columns = min(stride, label_stride);
+      vector<int> counts(word_occur.size() * stride, 0);
+      for (size_t w = 0; w < word_occur.size(); ++w) {
+        for (size_t l = 0; l < columns; ++l) {
+          counts[w * stride + l] = label_word_counts[w * label_stride + l];
+        }
+      }
+      label_word_counts.owned().swap(counts);
+      label_stride = stride;
+    }
+
+    int& count(int label, int word) {
+      return label_word_counts.owned()[word * label_stride + label];
+    }
+
+    int count(int label, int word) const {
+      return label_word_counts[word * label_stride + label];
+    }
+
+    // The counts gathered by one worker of train_parallel(), under the
+    // shard's own word and label ids. Each word keeps only the labels it
+    // occurred with, so a shard takes memory in proportion to the posts it
+    // saw rather than to the full word x label matrix, and merging it
+    // visits only the counts it holds.
+    struct TrainShard {
+      Tokenizer tokenizer;
+      Vocabulary words;
+      Vocabulary labels;
+      vector<int> word_occur;
+      vector<int> label_occur;
+      // (label, count) pairs for each word.
+      vector<vector<pair<int, int>>> word_labels;
+      int numPosts = 0;
+      // Global row on which each word and label id first appeared.
+      vector<size_t> word_first_row;
+      vector<size_t> label_first_row;
+
+      void train_post(string_view label, string_view content, size_t row) {
+        int label_id = labels.intern(label);
+        if (label_id == static_cast<int>(label_occur.size())) {
+          label_occur.push_back(0);
+          label_first_row.push_back(row);
+        }
+        ++label_occur[label_id];
+        for (string_view word : tokenizer.unique_words(content)) {
+          int word_id = words.intern(word);
+          if (word_id == static_cast<int>(word_occur.size())) {
+            word_occur.push_back(0);
+            word_labels.emplace_back();
+            word_first_row.push_back(row);
+          }
+          ++word_occur[word_id];
+          vector<pair<int, int>>& counts = word_labels[word_id];
+          auto it = find_if(counts.begin(), counts.end(),
+                            [label_id](const pair<int, int>& entry) {
+                              return entry.first == label_id;
+                            });
+          if (it == counts.end()) {
+            counts.emplace_back(label_id, 1);
+          }
+          else {
+            ++it->second;
+          }
+        }
+        ++numPosts;
+      }
+    };
     
   public:
     Classifier () {}
     
-    #include "csvstream.hpp"  // Include the csvstream library
-
-map<int, map<string, string>> storeString(csvstream& file) {
-    // Read all data from file into vector of maps
-    vector<map<string, string>> data;
-    map<string, string> row;
+    int wordCounter(){
+      return words.size();
+    }
 
-    // Read CSV file and extract only "tag" and "content" columns
-    while (file >> row) {
-        map<string, string> filtered_row;
-        filtered_row["tag"] = row["tag"];
-        filtered_row["content"] = row["content"];
-        data.push_back(filtered_row);
+    int postCounter() const {
+      return numPosts;
     }
 
-    // Create map of maps using the filtered vector
-    int index = 1;  // Start index from 1
-    for (const auto& row : data) {
-        string_storage[index][row.at("tag")] = row.at("content");
-        index++;  // Increment index for the next set of data
+    // Model files start with this magic string and a format version, which
+    // must be bumped whenever the layout below changes.
+    static constexpr char model_magic[8] = {'P','P','M','O','D','E','L','\0'};
+    static constexpr uint32_t model_version = 2;
+    // Written in native byte order; a file from a machine with the other
+    // byte order reads back as a different value and is rejected.
+    static constexpr uint32_t model_byte_order = 0x01020304;
+
+    // Finalizes the model and writes it to filename: the header, then the
+    // label and word vocabularies with their hash tables, label_occur,
+    // word_occur and the word x label count matrix, and finally the
+    // finalized log_prior, log_likelihood and label_order tables, each as
+    // one array. Throws runtime_error if the file cannot be written.
+    void save(const string& filename) {
+      finalize();
+      ofstream out(filename, ios::binary);
+      uint64_t posts = numPosts;
+      out.write(model_magic, sizeof(model_magic));
+      out.write(reinterpret_cast<const char*>(&model_version),
+                sizeof(model_version));
+      out.write(reinterpret_cast<const char*>(&model_byte_order),
+                sizeof(model_byte_order));
+      out.write(reinterpret_cast<const char*>(&posts), sizeof(posts));
+      labels.save(out);
+      words.save(out);
+      write_array(out, label_occur.data(), label_occur.size());
+      write_array(out, word_occur.data(), word_occur.size());
+      // The matrix is written with no spare label capacity.
+      const size_t num_labels = label_occur.size();
+      vector<int> counts(word_occur.size() * num_labels);
+      for (size_t w = 0; w < word_occur.size(); ++w) {
+        copy_n(&label_word_counts[w * label_stride], num_labels,
+               &counts[w * num_labels]);
+      }
+      write_array(out, counts.data(), counts.size());
+      write_array(out, log_prior.data(), log_prior.size());
+      write_array(out, log_likelihood.data(), log_likelihood.size());
+      write_array(out, label_order.data(), label_order.size());
+      out.close();
+      if (!out) {
+        throw runtime_error("Error writing model file: " + filename);
+      }
     }
 
-    return string_storage;
-}
+    // Replaces this model with one written by save(). The file is mapped
+    // and its arrays are used in place, already finalized, so loading
+    // costs a check of the header, the string tables and the sizes, and
+    // the rest of the file is paged in only as prediction touches it.
+    // Training a loaded model copies the arrays it changes. Throws
+    // runtime_error if the file cannot be read or is not a valid model,
+    // leaving this model unchanged.
+    void load(const string& filename) {
+      Classifier loaded;
+      loaded.view_model(filename);
+      *this = std::move(loaded);
+    }
 
+  private:
+    // Does the work of load() on an empty model.
+    void view_model(const string& filename) {
+      unique_ptr<MappedFile> file(new MappedFile(filename));
+      const char* p = file->begin();
+      const char* end = file->end();
+      const size_t header_size = sizeof(model_magic) + 2 * sizeof(uint32_t)
+                                 + sizeof(uint64_t);
+      if (end - p < static_cast<ptrdiff_t>(header_size) ||
+          memcmp(p, model_magic, sizeof(model_magic)) != 0) {
+        throw runtime_error("Not a model file: " + filename);
+      }
+      p += sizeof(model_magic);
+      uint32_t version, byte_order;
+      uint64_t posts;
+      memcpy(&version, p, sizeof(version));
+      p += sizeof(version);
+      memcpy(&byte_order, p, sizeof(byte_order));
+      p += sizeof(byte_order);
+      memcpy(&posts, p, sizeof(posts));
+      p += sizeof(posts);
+      if (version != model_version || byte_order != model_byte_order) {
+        throw runtime_error("Unsupported model file version: " + filename);
+      }
+      if (posts > static_cast<uint64_t>(numeric_limits<int>::max())) {
+        throw runtime_error("Model file has an invalid post count: " +
+                            filename);
+      }
 
-    void clearMap() {
-      string_storage.clear();
+      try {
+        labels.view(p, end);
+        words.view(p, end);
+        view_array(p, end, label_occur);
+        view_array(p, end, word_occur);
+        view_array(p, end, label_word_counts);
+        view_array(p, end, log_prior);
+        view_array(p, end, log_likelihood);
+        view_array(p, end, label_order);
+      }
+      catch (const runtime_error& e) {
+        throw runtime_error(string(e.what()) + ": " + filename);
+      }
+      const size_t num_labels = labels.size();
+      const size_t num_words = words.size();
+      bool ok = label_occur.size() == num_labels &&
+                word_occur.size() == num_words &&
+                label_word_counts.size() == num_words * num_labels &&
+                log_prior.size() == num_labels &&
+                log_likelihood.size() == num_words * num_labels &&
+                label_order.size() == num_labels;
+      for (size_t i = 0; ok && i < label_order.size(); ++i) {
+        ok = label_order[i] >= 0 &&
+             static_cast<size_t>(label_order[i]) < num_labels;
+      }
+      if (!ok) {
+        throw runtime_error("Model file has inconsistent sizes: " + filename);
+      }
+      model_file = std::move(file);
+      label_stride = num_labels;
+      numPosts = static_cast<int>(posts);
+      log_unseen = log(1 / static_cast<double>(numPosts));
+      finalized = true;
     }
 
-    int wordCounter(){
-      return word_occur.size();
+  public:
+    // Adds one post to the model.
+    void train_post(string_view label, string_view content) {
+      int label_id = intern_label(label);
+      ++label_occur.owned()[label_id];
+      for (string_view word : tokenizer.unique_words(content)) {
+        int word_id = intern_word(word);
+        ++word_occur.owned()[word_id];
+        ++count(label_id, word_id);
+      }
+      ++numPosts;
+      finalized = false;
     }
 
-    int countPosts(map<int, map<string, string>> string_storage) {
-      int highest_n= 0;
-      for (const auto& pair : string_storage) {
-        const int& n_value = pair.first;
-        if (n_value > highest_n) {
-          highest_n = n_value;
+    // Reads the "tag" and "content" of every row in file and adds it to the
+    // model in a single pass, keeping only the counts. When echo is true,
+    // each row is printed in the "training data:" format as it is read.
+    // Returns the number of posts trained on.
+    int train(csvstream& file, bool echo = false) {
+      vector<string_view> row;
+      file.select({"tag", "content"});
+      if (echo) {
+        cout << "training data:" << endl;
+      }
+      while (file >> row) {
+        string_view label = row[0];
+        string_view content = row[1];
+        if (echo) {
+          cout << "  label = " << label;
+          cout << ", content = " << content << endl;
         }
+        train_post(label, content);
       }
-      numPosts = highest_n;
-      return highest_n;
+      return numPosts;
     }
 
-    void wordOccurances(map<int, map<string, string>> string_storage) {
-      for (const auto& outerPair : string_storage) {
-        for (const auto& innerPair : outerPair.second) {
-          set<string> uniqueWordsInString = unique_words(innerPair.second);
+    // Like train(), but tokenizing and counting are spread over num_threads
+    // worker threads. Rows are handed out in batches; each worker counts
+    // into a private sparse shard, and the shards are merged so that the
+    // result is identical to training sequentially, down to the id of every
+    // word and label. With one thread this is just train().
+    int train_parallel(csvstream& file, int num_threads, bool echo = false) {
+      if (num_threads <= 1) {
+        return train(file, echo);
+      }
+      const size_t batch_size = 1024;
+      struct Batch {
+        size_t first_row;
+        vector<pair<string, string>> rows;
+      };
+
+      vector<TrainShard> shards(num_threads);
+      deque<Batch> queue;
+      bool done = false;
+      mutex queue_mutex;
+      condition_variable queue_ready;
+      condition_variable queue_space;
 
-          for (const auto& uniqueWord : uniqueWordsInString) {
-            if (uniqueWordsInString.count(uniqueWord)) {
-                ++word_occur[uniqueWord];
+      auto work = [&](TrainShard& shard) {
+        while (true) {
+          Batch batch;
+          {
+            unique_lock<mutex> lock(queue_mutex);
+            queue_ready.wait(lock, [&] { return done || !queue.empty(); });
+            if (queue.empty()) {
+              return;
             }
+            batch = std::move(queue.front());
+            queue.pop_front();
+          }
+          queue_space.notify_one();
+          for (size_t i = 0; i < batch.rows.size(); ++i) {
+            shard.train_post(batch.rows[i].first, batch.rows[i].second,
+                             batch.first_row + i);
+          }
+        }
+      };
+
+      vector<thread> workers;
+      for (TrainShard& shard : shards) {
+        workers.emplace_back(work, ref(shard));
+      }
+
+      // Read on this thread, keeping at most two batches per worker queued.
+      vector<string_view> row;
+      file.select({"tag", "content"});
+      Batch batch = {0, {}};
+      size_t num_rows = 0;
+      if (echo) {
+        cout << "training data:" << endl;
+      }
+      while (true) {
+        bool more = static_cast<bool>(file >> row);
+        if (more) {
+          if (echo) {
+            cout << "  label = " << row[0];
+            cout << ", content = " << row[1] << endl;
           }
+          batch.rows.emplace_back(row[0], row[1]);
+          ++num_rows;
         }
+        if (batch.rows.size() == batch_size || (!more && !batch.rows.empty())) {
+          unique_lock<mutex> lock(queue_mutex);
+          queue_space.wait(lock, [&] {
+            return queue.size() < 2 * shards.size();
+          });
+          queue.push_back(std::move(batch));
+          lock.unlock();
+          queue_ready.notify_one();
+          batch = {num_rows, {}};
+        }
+        if (!more) {
+          break;
+        }
+      }
+      {
+        lock_guard<mutex> lock(queue_mutex);
+        done = true;
+      }
+      queue_ready.notify_all();
+      for (thread& worker : workers) {
+        worker.join();
       }
+
+      merge_shards(shards);
+      return numPosts;
     }
 
-    void labelOccurances(map<int, map<string, string>> string_storage) {
-      for (const auto& outerPair : string_storage) {
-        for (const auto& innerPair : outerPair.second) {
-          string word = innerPair.first;
-          uniqueLabelsInString.insert(word);
+    // Folds the counts of every shard into this model. New labels and words
+    // are interned in order of the row they first appeared on (ties within
+    // a row broken by the shard's own first-appearance order), which is the
+    // order sequential training would have assigned ids in. Only the counts
+    // the shards hold are visited.
+    void merge_shards(const vector<TrainShard>& shards) {
+      vector<vector<int>> label_ids(shards.size());
+      vector<vector<int>> word_ids(shards.size());
+      vector<tuple<size_t, size_t, int>> order;
+
+      for (size_t s = 0; s < shards.size(); ++s) {
+        for (int id = 0; id < shards[s].labels.size(); ++id) {
+          order.emplace_back(shards[s].label_first_row[id], s, id);
         }
       }
+      sort(order.begin(), order.end());
+      for (size_t s = 0; s < shards.size(); ++s) {
+        label_ids[s].resize(shards[s].labels.size());
+      }
+      for (const auto& entry : order) {
+        size_t s = get<1>(entry);
+        int id = get<2>(entry);
+        label_ids[s][id] = intern_label(shards[s].labels.name(id));
+      }
 
-      for (const auto& outerPair : string_storage) {
-        for (const auto& innerPair : outerPair.second) {
-            const string& innerFirst = innerPair.first;
-            for (const auto& label : uniqueLabelsInString) {
-                if (innerFirst == label) {
-                    ++label_occur[label];
-                }
-            }
+      order.clear();
+      for (size_t s = 0; s < shards.size(); ++s) {
+        for (int id = 0; id < shards[s].words.size(); ++id) {
+          order.emplace_back(shards[s].word_first_row[id], s, id);
         }
-    }
-    }
+      }
+      sort(order.begin(), order.end());
+      for (size_t s = 0; s < shards.size(); ++s) {
+        word_ids[s].resize(shards[s].words.size());
+      }
+      for (const auto& entry : order) {
+        size_t s = get<1>(entry);
+        int id = get<2>(entry);
+        word_ids[s][id] = intern_word(shards[s].words.name(id));
+      }
 
-    void wordAndLabel(const map<int, map<string, string>>& string_storage) {
-      for (const auto& outerPair : string_storage) {
-        for (const auto& innerPair : outerPair.second) {
-          const string& label = innerPair.first;
-          const string& content = innerPair.second;
-          
-          set<string> uniqueWordsInContent = unique_words(content);
-          
-          for (const auto& word : uniqueWordsInContent) {
-            label_word_counts[label][word]++;
+      for (size_t s = 0; s < shards.size(); ++s) {
+        const TrainShard& shard = shards[s];
+        numPosts += shard.numPosts;
+        for (int l = 0; l < shard.labels.size(); ++l) {
+          label_occur.owned()[label_ids[s][l]] += shard.label_occur[l];
+        }
+        for (int w = 0; w < shard.words.size(); ++w) {
+          int word = word_ids[s][w];
+          word_occur.owned()[word] += shard.word_occur[w];
+          for (const pair<int, int>& entry : shard.word_labels[w]) {
+            count(label_ids[s][entry.first], word) += entry.second;
           }
         }
       }
+      finalized = false;
     }
 
-    double logPC(string label) {
-      return log(label_occur[label] / static_cast<double>(numPosts));
-    }
-
-    double logPWC(string label, string word) {
-      if (label_word_counts.count(label) && 
-          label_word_counts[label].count(word)) {
-        return log(label_word_counts[label][word] 
-                / static_cast<double>(label_occur[label]));
+    // Freezes the model for prediction by precomputing every log-probability
+    // the scorer needs into flat tables. Training again un-freezes it; this
+    // must be called once more before the const prediction functions.
+    void finalize() {
+      if (finalized) {
+        return;
       }
-      else if (word_occur.count(word)) {
-        return log(word_occur[word] / static_cast<double>(numPosts));
+      const size_t num_labels = labels.size();
+      const double posts = static_cast<double>(numPosts);
+      vector<double>& prior = log_prior.owned();
+      prior.resize(num_labels);
+      for (size_t l = 0; l < num_labels; ++l) {
+        prior[l] = log(label_occur[l] / posts);
       }
-      else {
-        return log(1 / static_cast<double>(numPosts));
+      vector<double>& likelihood = log_likelihood.owned();
+      likelihood.resize(word_occur.size() * num_labels);
+      for (size_t w = 0; w < word_occur.size(); ++w) {
+        double fallback = log(word_occur[w] / posts);
+        const int* counts = &label_word_counts[w * label_stride];
+        double* row = &likelihood[w * num_labels];
+        for (size_t l = 0; l < num_labels; ++l) {
+          row[l] = counts[l] > 0
+            ? log(counts[l] / static_cast<double>(label_occur[l]))
+            : fallback;
+        }
       }
+      log_unseen = log(1 / posts);
+      // Labels are compared in name order so ties go to the smallest label.
+      label_order.owned() = labels.sorted_ids();
+      finalized = true;
     }
 
-    pair<string, double> predict(string content) {
-      map<string, double> label_prob;
-      for (const auto& label : uniqueLabelsInString) {
-        double prob = 0;
-        for (const auto& word : unique_words(content)) {
-          prob += logPWC(label, word);
+    // REQUIRES: finalize() has been called since training
+    double logPC(int label) const {
+      return log_prior[label];
+    }
+
+    // REQUIRES: finalize() has been called since training
+    // A word id of -1 stands for a word never seen in training.
+    double logPWC(int label, int word) const {
+      if (word == -1) {
+        return log_unseen;
+      }
+      return log_likelihood[word * labels.size() + label];
+    }
+
+    // Scores every label for the post whose word ids are in
+    // scratch.post_words, writing the log-probability of label l to
+    // scratch.label_scores[l].
+    void score_labels(PredictScratch& scratch) const {
+      const size_t num_labels = labels.size();
+      vector<double>& label_scores = scratch.label_scores;
+      label_scores.assign(num_labels, 0);
+      for (int word : scratch.post_words) {
+        if (word == -1) {
+          for (size_t l = 0; l < num_labels; ++l) {
+            label_scores[l] += log_unseen;
+          }
+          continue;
         }
-        prob += logPC(label);
-        label_prob[label] = prob;
-      }
-      string highest_label = "";
-      double highest_prob = -10000000;
-      for (const auto& pair : label_prob) {
-        if (pair.second > highest_prob) {
-          highest_label = pair.first;
-          highest_prob = pair.second;
+        const double* row = &log_likelihood[word * num_labels];
+        for (size_t l = 0; l < num_labels; ++l) {
+          label_scores[l] += row[l];
         }
       }
-      return pair<string, double>(highest_label, highest_prob);
+      for (size_t l = 0; l < num_labels; ++l) {
+        label_scores[l] += log_prior[l];
+      }
     }
 
-    // for each, prints out labal and content
-    void printTrainingData(map<int, map<string, string>> string_storage) {
-      cout << "training data:" << endl;
-      for (const auto& outerPair : string_storage) {
-        for (const auto& innerPair : outerPair.second) {
-          cout << "  label = " << innerPair.first;
-          cout << ", content = " << innerPair.second << endl;
+    // REQUIRES: results points to at least count Predictions, and
+    //           finalize() has been called since training
+    // EFFECTS:  Predicts a label for each of the count posts, tokenizing
+    //           each post once and scoring all labels together. Safe to
+    //           call from several threads, each with its own scratch.
+    void predict_batch(const string* posts, size_t count,
+                       Prediction* results, PredictScratch& scratch) const {
+      for (size_t i = 0; i < count; ++i) {
+        scratch.post_words.clear();
+        for (string_view word : scratch.tokenizer.unique_words(posts[i])) {
+          scratch.post_words.push_back(words.lookup(word));
+        }
+        score_labels(scratch);
+        Prediction best = {-1, -10000000};
+        for (int label : label_order) {
+          if (scratch.label_scores[label] > best.score) {
+            best = {label, scratch.label_scores[label]};
           }
+        }
+        results[i] = best;
       }
     }
 
+    // REQUIRES: results points to at least count Predictions
+    // EFFECTS:  Predicts a label for each of the count posts, tokenizing
+    //           each post once and scoring all labels together.
+    void predict_batch(const string* posts, size_t count,
+                       Prediction* results) {
+      finalize();
+      predict_batch(posts, count, results, scratch);
+    }
+
+    string_view label_name(int label) const {
+      return labels.name(label);
+    }
+
+    // Like label_name(), but the empty string for a prediction of -1.
+    string predicted_name(const Prediction& result) const {
+      return result.label == -1 ? "" : string(labels.name(result.label));
+    }
+
+    pair<string, double> predict(string content) {
+      Prediction result;
+      predict_batch(&content, 1, &result);
+      return pair<string, double>(predicted_name(result), result.score);
+    }
+
     // print out each label, number of examples it was trained on,
     // and the value for log-prior
     // print all of these using a for loop to iterate through the labels
     void printClasses() {
+      finalize();
       cout << "classes:" << endl;
-      for (const auto& pair : label_occur) {
-        const std::string& label = pair.first;
-        cout << "  " << label;
-        cout << ", " << pair.second << " examples";
+      for (int label : labels.sorted_ids()) {
+        cout << "  " << labels.name(label);
+        cout << ", " << label_occur[label] << " examples";
         cout << ", log-prior = " << logPC(label) << endl;
       }
 }
@@ -206,14 +847,14 @@ map<int, map<string, string>> storeString(csvstream& file) {
     // euchre:twice, count = 1, log-likelihood = -1.61
     // euchre:upcard, count = 2, log-likelihood = -0.916
     void printClassifierParamaters() {
+      finalize();
       cout << "classifier parameters:" << endl;
-      for (const auto& labelPair : label_occur) {
-        const string& label = labelPair.first;
-        for (const auto& wordPair : word_occur) {
-          const string& word = wordPair.first;
-          if (label_word_counts[label][word] > 0) {
-            cout << "  " << label << ":" << word << ", count = " 
-            << label_word_counts[label][word];
+      vector<int> sorted_words = words.sorted_ids();
+      for (int label : labels.sorted_ids()) {
+        for (int word : sorted_words) {
+          if (count(label, word) > 0) {
+            cout << "  " << labels.name(label) << ":" << words.name(word)
+            << ", count = " << count(label, word);
             cout << ", log-likelihood = " << logPWC(label, word) << endl;
           }
         }
@@ -221,66 +862,233 @@ map<int, map<string, string>> storeString(csvstream& file) {
       cout << endl;
     }
 
-    void printTestData(map<int, map<string, string>> test_string_storage) {
-      cout << "test data:" << endl;
-      for (const auto& outerPair : string_storage) {
-        for (const auto& innerPair : outerPair.second) {
-          cout << "  correct = " << innerPair.first;
-          cout << ", predicted = " << predict(innerPair.second).first;
-          cout << ", log-probability score = " 
-               << predict(innerPair.second).second << endl;
-          cout << "  content = " << innerPair.second << endl << endl;
-          }
-      }
-    }
-    
-    // Print the number of correct predictions and total number of test posts.
+    // Scores every post in file once on num_threads worker threads and prints
+    // the "test data:" listing in input order, followed by the number of
+    // correct predictions and total number of test posts.
     // ex:
     // performance: 2 / 3 posts predicted correctly
-    void printPerformance(map<int, map<string, string>> 
-                          test_string_storage) {
+    void evaluate(csvstream& file, int num_threads) {
+      const size_t batch_size = 256;
+      struct Batch {
+        size_t seq;
+        vector<string> labels;
+        vector<string> contents;
+        vector<Prediction> results;
+      };
+
+      finalize();
       int correct = 0;
       int total = 0;
-      for (const auto& outerPair : string_storage) {
-        for (const auto& innerPair : outerPair.second) {
-          if (innerPair.first == predict(innerPair.second).first) {
+      auto print_batch = [&](const Batch& batch) {
+        for (size_t i = 0; i < batch.labels.size(); ++i) {
+          const string& label = batch.labels[i];
+          const string& content = batch.contents[i];
+          string predicted = predicted_name(batch.results[i]);
+          cout << "  correct = " << label;
+          cout << ", predicted = " << predicted;
+          cout << ", log-probability score = "
+               << batch.results[i].score << endl;
+          cout << "  content = " << content << endl << endl;
+          if (label == predicted) {
             correct++;
           }
           total++;
+        }
+      };
+      auto score_batch = [this](Batch& batch, PredictScratch& scratch) {
+        batch.results.resize(batch.contents.size());
+        predict_batch(batch.contents.data(), batch.contents.size(),
+                      batch.results.data(), scratch);
+      };
+
+      // Batches go from this thread to the workers through pending, and come
+      // back through finished, keyed by sequence number so they can be
+      // printed in order. At most two batches per worker are in flight.
+      deque<Batch> pending;
+      map<size_t, Batch> finished;
+      size_t next_to_print = 0;
+      size_t num_batches = 0;
+      bool done = false;
+      mutex state_mutex;
+      condition_variable work_ready;
+      condition_variable work_finished;
+
+      auto work = [&]() {
+        PredictScratch scratch;
+        while (true) {
+          Batch batch;
+          {
+            unique_lock<mutex> lock(state_mutex);
+            work_ready.wait(lock, [&] { return done || !pending.empty(); });
+            if (pending.empty()) {
+              return;
+            }
+            batch = std::move(pending.front());
+            pending.pop_front();
+          }
+          score_batch(batch, scratch);
+          {
+            lock_guard<mutex> lock(state_mutex);
+            size_t seq = batch.seq;
+            finished.emplace(seq, std::move(batch));
+          }
+          work_finished.notify_one();
+        }
+      };
+
+      // Prints finished batches in order, blocking until every batch before
+      // next_limit has been printed.
+      auto drain = [&](size_t next_limit) {
+        unique_lock<mutex> lock(state_mutex);
+        while (next_to_print < next_limit) {
+          work_finished.wait(lock, [&] {
+            return finished.count(next_to_print) != 0;
+          });
+          Batch batch = std::move(finished[next_to_print]);
+          finished.erase(next_to_print);
+          ++next_to_print;
+          lock.unlock();
+          print_batch(batch);
+          lock.lock();
+        }
+      };
+
+      vector<thread> workers;
+      if (num_threads > 1) {
+        for (int t = 0; t < num_threads; ++t) {
+          workers.emplace_back(work);
+        }
+      }
+
+      cout << "test data:" << endl;
+      vector<string_view> row;
+      file.select({"tag", "content"});
+      Batch batch = {0, {}, {}, {}};
+      bool more = true;
+      while (more) {
+        more = static_cast<bool>(file >> row);
+        if (more) {
+          batch.labels.emplace_back(row[0]);
+          batch.contents.emplace_back(row[1]);
+        }
+        if (batch.labels.size() < batch_size &&
+            (more || batch.labels.empty())) {
+          continue;
+        }
+        if (workers.empty()) {
+          score_batch(batch, scratch);
+          print_batch(batch);
+        }
+        else {
+          size_t in_flight = 2 * workers.size();
+          if (num_batches >= in_flight) {
+            drain(num_batches - in_flight + 1);
+          }
+          {
+            lock_guard<mutex> lock(state_mutex);
+            pending.push_back(std::move(batch));
           }
+          work_ready.notify_one();
+        }
+        batch = {++num_batches, {}, {}, {}};
+      }
+      if (!workers.empty()) {
+        drain(num_batches);
+        {
+          lock_guard<mutex> lock(state_mutex);
+          done = true;
+        }
+        work_ready.notify_all();
+        for (thread& worker : workers) {
+          worker.join();
+        }
       }
-      cout << "performance: " << correct << " / " << total 
+
+      cout << "performance: " << correct << " / " << total
            << " posts predicted correctly" << endl;
     }
     
 };
 
 int main(int argc, char* argv[]) {
-  set<string> unique_word_set;
   int total_posts = 0;
   int total_unique_words = 0;
-  map<int, map<string, string>> string_storage_main;
-  map<int, map<string, string>> string_storage_test;
   cout.precision(3);
-  if (((argc != 3) && (argc != 4)) || ((argc == 4) && 
-      (strcmp(argv[3], "--debug") != 0))) {
-    cout << "Usage: main.exe TRAIN_FILE TEST_FILE [--debug]" << endl;
-    return 1;
-  };
   bool isDebug = false;
-  if ((argc == 4) && !(strcmp(argv[3], "--debug"))) {
-    isDebug = true;
+  int numThreads = 1;
+  const char* saveModel = nullptr;
+  const char* loadModel = nullptr;
+  vector<const char*> files;
+  bool argsOk = true;
+  for (int i = 1; argsOk && i < argc; ++i) {
+    if (!strcmp(argv[i], "--debug")) {
+      isDebug = true;
+    }
+    else if (!strcmp(argv[i], "--threads") && i + 1 < argc) {
+      numThreads = atoi(argv[++i]);
+      argsOk = numThreads > 0;
+    }
+    else if (!strcmp(argv[i], "--save-model") && i + 1 < argc) {
+      saveModel = argv[++i];
+    }
+    else if (!strcmp(argv[i], "--load-model") && i + 1 < argc) {
+      loadModel = argv[++i];
+    }
+    else {
+      files.push_back(argv[i]);
+    }
+  }
+  // Either TRAIN_FILE TEST_FILE, or TRAIN_FILE alone when only saving a
+  // model, or TEST_FILE alone when the model is loaded.
+  if (loadModel) {
+    argsOk = argsOk && !saveModel && files.size() == 1;
+  }
+  else {
+    argsOk = argsOk && (files.size() == 2 || (saveModel && files.size() == 1));
   }
-  csvstream trainFile(argv[1]);
-  csvstream testFile(argv[2]);
+  if (!argsOk) {
+    cout << "Usage: main.exe TRAIN_FILE TEST_FILE [--debug] [--threads N]"
+         << " [--save-model MODEL_FILE]" << endl;
+    cout << "       main.exe TRAIN_FILE --save-model MODEL_FILE [--threads N]"
+         << endl;
+    cout << "       main.exe --load-model MODEL_FILE TEST_FILE [--debug]"
+         << " [--threads N]" << endl;
+    return 1;
+  };
   Classifier train;
 
-  string_storage_main = train.storeString(trainFile);
-  total_posts = train.countPosts(string_storage_main);
-  train.wordOccurances(string_storage_main);
-  train.labelOccurances(string_storage_main);
-  train.wordAndLabel(string_storage_main);
+  if (loadModel) {
+    try {
+      train.load(loadModel);
+    }
+    catch (const runtime_error& e) {
+      cout << e.what() << endl;
+      return 1;
+    }
+    total_posts = train.postCounter();
+  }
+  else {
+    // The training file is streamed straight into the model; in debug mode
+    // each row is echoed as it is read.
+    csvstream trainFile(files[0], ',', true, true);
+    if (numThreads > 1) {
+      total_posts = train.train_parallel(trainFile, numThreads, isDebug);
+    }
+    else {
+      total_posts = train.train(trainFile, isDebug);
+    }
+  }
   total_unique_words = train.wordCounter();
+  train.finalize();
+  if (saveModel) {
+    try {
+      train.save(saveModel);
+    }
+    catch (const runtime_error& e) {
+      cout << e.what() << endl;
+      return 1;
+    }
+  }
 
   // take the words from the post in the test file
   // iterate through the labels from the training set
@@ -288,10 +1096,6 @@ int main(int argc, char* argv[]) {
   // adding the log of all the words together
   // store the first one as the greatest value and
   // subsequently compare all following against the first
-  if (isDebug) {
-    train.printTrainingData(string_storage_main); // if debug
-  }
-  train.clearMap();
   cout << "trained on " << total_posts << " examples" << endl;
 
   if (isDebug) {
@@ -299,7 +1103,8 @@ int main(int argc, char* argv[]) {
     train.printClasses(); // if debug
     train.printClassifierParamaters(); // if debug
   }
-  string_storage_test = train.storeString(testFile);
-  train.printTestData(string_storage_test);
-  train.printPerformance(string_storage_test);
-}
\ No newline at end of file
+  if (files.size() == (loadModel ? 1 : 2)) {
+    csvstream testFile(files.back(), ',', true, true);
+    train.evaluate(testFile, numThreads);
+  }
+}